@@ -0,0 +1,40 @@
+/* C interface to the flowers decision tree, built as a library with
+ *   g++ -std=c++14 -pthread -O2 -shared -fPIC -fvisibility=hidden -Wl,--version-script=fdt.map -DFDT_LIBRARY -o libfdt.so tree.cc
+ * Flowers are passed as columns: features[0..3] point to rows sepal lengths,
+ * sepal widths, petal lengths and petal widths, and classes to rows classes
+ * (0 setosa, 1 versicolor, 2 virginica). The library reads the caller's arrays
+ * in place and never keeps them once a call returns. */
+#ifndef FDT_H
+#define FDT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __GNUC__
+#define FDT_API __attribute__((visibility("default"))) /* the only symbols libfdt exports */
+#else
+#define FDT_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fdt_model fdt_model; /* a trained tree */
+
+/* trains a tree of at most max_depth levels below the root whose leaves hold at least min_leaf flowers;
+   NULL on failure, including classes outside 0 to 2 and more than INT32_MAX rows */
+FDT_API fdt_model *fdt_train(double const *const features[4], int32_t const *classes, size_t rows, int max_depth, int min_leaf);
+
+/* writes the predicted class of each of rows flowers to classes */
+FDT_API void fdt_predict(fdt_model const *model, double const *const features[4], size_t rows, int32_t *classes);
+
+FDT_API fdt_model *fdt_load(char const *path); /* NULL if path holds no model */
+FDT_API int fdt_save(fdt_model const *model, char const *path); /* 0 on success, -1 on failure */
+FDT_API void fdt_free(fdt_model *model);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,17 +7,167 @@
 #include <random>    // std::mt19937
 #include <iomanip>   // std::setprecision
 #include <memory>    // std::unique_ptr
+#include <thread>    // std::thread
+#include <mutex>     // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <future>    // std::future, std::packaged_task
+#include <deque>     // std::deque
+#include <functional> // std::function
+#include <fstream>   // std::ifstream
+#include <atomic>    // std::atomic
+#include <chrono>    // std::chrono::steady_clock
+#include <unordered_map> // std::unordered_map
+#include <map>       // std::map
+#include <tuple>     // std::tuple
+#include <limits>    // std::numeric_limits
+#include <shared_mutex> // std::shared_timed_mutex
+#include <queue>     // std::priority_queue
+#include <array>     // std::array
+#include <iterator>  // std::back_inserter
+#include <cstring>   // std::memcpy
+#include <cstdio>    // std::rename
+#include "fdt.h"     // the C interface
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h> // gathers, compress stores
+#endif
+#include <cstdint>   // std::uintptr_t
+#ifdef __linux__
+#include <sched.h>   // sched_setaffinity
+#include <sys/mman.h> // mmap, madvise
+#include <sys/stat.h> // fstat
+#include <fcntl.h>   // open
+#include <unistd.h>  // close
+#endif
 
 namespace fdt { // flowers decision tree
 
 namespace { // anonymous namespace; nothing outside fdt can access members
-	int    max_depth;
 	enum   Class { setosa, versicolor, virginica };
 	enum   Feature { SL /* sepal length */, SW /* sepal width */, PL /* petal length */, PW /* petal width */ };
+	char   const *const feature_names[] = { "SL", "SW", "PL", "PW" };
 	double linlog(double x) { return (x == 0) ? 0 : x * std::log2(x); } // the linealogarithm function
 	double I(double x, double y, double z) { return 0 - linlog(x) - linlog(y) - linlog(z); } // the information gain function
+	int    const parallel_rows = 256; // Nodes with fewer flowers build their subtrees on the calling thread
+	int    const batch_rows = 16;     // rows a FlatTree walks in lockstep
+	int    const forest_lanes = 8;    // trees a Forest walks in lockstep for one row
+	int    const cache_rows = 256;    // rows a PredictionCache looks up before predicting their misses together
+	int    const confident_trees = 16; // trees a Forest walks before a confidence stop may end the vote
+	int    const max_targets = 4;     // Classes a multi-output tree predicts per flower; a leaf packs them in base 3
+	int    const partition_slack = 16; // slots past its rows that partition may write
+	int    const run_rows = 4;        // rows per value a Feature needs at a Node for storing its Runs to pay off
+	float  const approx_gain_error = 1e-4f; // bounds |approx_gains - Node::gain| per target below 2^24 rows, with a wide margin
+	enum   Layout { dfs_layout, bfs_layout, veb_layout }; // node orders a FlatTree can use
+	enum   Buffer { dataset_buffer, scratch_buffer }; // what a HugePageAllocator allocates for
+	std::size_t const huge_page = 2 << 20; // buffers at least this large are backed by huge pages when possible
+	std::size_t const max_rows = INT32_MAX; // flowers one tree trains on; Runs, split indices, covers and gathered rows are int32
+
+	struct PageStats { // per Buffer kind, counts of huge-page-sized allocations and how they were backed
+		std::atomic<long> buffers{0};
+		std::atomic<long> hugetlb{0}; // explicit huge pages (MAP_HUGETLB)
+		std::atomic<long> thp{0};     // transparent huge pages (madvise)
+	} page_stats[2];
+
+	std::atomic<long> generations{0}; // stamps every model change, so caches can tell a reloaded model apart
+
+	std::vector<int> parse_cpulist(std::string const &list) { // "0-3,8" -> {0, 1, 2, 3, 8}
+		std::vector<int> cpus;
+		std::stringstream ss(list);
+		std::string range;
+		while (getline(ss, range, ',')) {
+			if (range.empty() || range == "\n") continue;
+			std::size_t dash = range.find('-');
+			int first = std::stoi(range.substr(0, dash));
+			int last  = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+			for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+		}
+		return cpus;
+	}
+
+	std::vector<std::vector<int>> numa_cpus() { // usable cpus of each NUMA node; a single node if the topology is unknown
+		std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		sched_getaffinity(0, sizeof(allowed), &allowed);
+		for (int n = 0; ; n++) {
+			std::ifstream in("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+			std::string list;
+			if (!getline(in, list)) break;
+			std::vector<int> cpus;
+			for (int cpu : parse_cpulist(list)) {
+				if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+			}
+			if (!cpus.empty()) nodes.push_back(cpus);
+		}
+#endif
+		if (nodes.empty()) {
+			nodes.emplace_back();
+			for (int cpu = 0; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); cpu++) nodes[0].push_back(cpu);
+		}
+		return nodes;
+	}
+
+	int feature_of(std::string const &name) { // the Feature a Node's feature_ names, or -1 for a leaf
+		if (name == "SL") return SL;
+		if (name == "SW") return SW;
+		if (name == "PL") return PL;
+		if (name == "PW") return PW;
+		return -1;
+	}
+
+	inline void prefetch(void const *p) {
+#ifdef __GNUC__
+		__builtin_prefetch(p);
+#endif
+	}
+
+#ifndef FDT_LIBRARY // command line helpers
+	Layout layout_of(std::string const &name) { // "dfs", "bfs" or "veb"
+		if (name == "bfs") return bfs_layout;
+		if (name == "veb") return veb_layout;
+		return dfs_layout;
+	}
+
+	bool flag(int &argc, char **argv, std::string const &name) { // removes "--name" from argv; returns whether it was there
+		for (int i = 1; i < argc; i++) {
+			if (argv[i] == "--" + name) {
+				std::copy(argv + i + 1, argv + argc + 1, argv + i);
+				argc--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	char *option(int &argc, char **argv, std::string const &name) { // removes "--name value" from argv; returns value or nullptr
+		for (int i = 1; i + 1 < argc; i++) {
+			if (argv[i] == "--" + name) {
+				char *value = argv[i+1];
+				std::copy(argv + i + 2, argv + argc + 1, argv + i);
+				argc -= 2;
+				return value;
+			}
+		}
+		return nullptr;
+	}
+#endif
 }
 
+template <class T, Buffer B>
+struct HugePageAllocator { // std allocator backing large buffers with 2 MB pages, falling back to THP and then 4 KB pages
+	typedef T value_type;
+	template <class U> struct rebind { typedef HugePageAllocator<U, B> other; };
+
+	HugePageAllocator() = default;
+	template <class U> HugePageAllocator(HugePageAllocator<U, B> const &) {}
+	T   *allocate(std::size_t n);
+	void deallocate(T *p, std::size_t n);
+	template <class U> void construct(U *p) { ::new (static_cast<void *>(p)) U; } // default, not zero: resize leaves new pages to their first writer
+	template <class U, class... Args> void construct(U *p, Args &&... args) { ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...); }
+	bool operator==(HugePageAllocator const &) const { return true; }
+	bool operator!=(HugePageAllocator const &) const { return false; }
+};
+
 class Flower {
 	double sl_;    // sepal length
 	double sw_;    // sepal width
@@ -28,33 +178,319 @@ class Flower {
 public:
 	double feature(Feature f) const; // the value of Feature f for this Flower
 	Class  get_class() const { return class_; }
-	void   read_from(std::string const &line); // reads this Flower's data from line
+	bool   read_from(std::string const &line); // reads this Flower's data from line; false unless it holds four values and a Class
+};
+
+typedef std::vector<Flower, HugePageAllocator<Flower, dataset_buffer>> Dataset; // flowers as loaded
+typedef std::vector<Flower, HugePageAllocator<Flower, scratch_buffer>> Flowers; // flowers drawn for one tree
+typedef std::vector<std::uint32_t, HugePageAllocator<std::uint32_t, scratch_buffer>> Rows; // indices of the flowers held by a Node
+template <class T> using Column = std::vector<T, HugePageAllocator<T, dataset_buffer>>; // one Feature, Class or response per row
+
+struct Columns { // flowers stored as one array per Feature and one of Classes, owned by whoever made them
+	double       const *feature[4];
+	std::int32_t const *classes; // targets Classes per row, row after row
+	double       const *response = nullptr; // a regression tree's target, in place of classes
+	std::size_t         rows;
+	int                 targets = 1;
+	std::uint8_t const *codes[4] = {}; // bin codes in place of a Feature's values, if set
+	double       const *edges[4] = {}; // code c holds the values from edges[c-1] up to, not including, edges[c]
+
+	double value(std::uint32_t row, Feature f) const { return codes[f] ? codes[f][row] : feature[f][row]; }
+	double lowest(std::uint32_t row, Feature f) const { // the smallest value row may have; compares with edges as the value does
+		if (!codes[f]) return feature[f][row];
+		return codes[f][row] ? edges[f][codes[f][row] - 1] : -std::numeric_limits<double>::infinity();
+	}
+	Class  get_class(std::uint32_t row, int target = 0) const { return (Class)classes[row * targets + target]; }
+	bool   agree(std::uint32_t r1, std::uint32_t r2) const { return response ? response[r1] == response[r2] : label(r1) == label(r2); }
+	std::int32_t label(std::uint32_t row) const { // every target's Class packed in base 3
+		std::int32_t packed = 0;
+		for (int t = targets - 1; t >= 0; t--) packed = 3 * packed + get_class(row, t);
+		return packed;
+	}
+};
+
+class ThreadPool;
+std::shared_ptr<Columns const> columns_of(Flower const *flowers, std::size_t count, ThreadPool *pool = nullptr); // a copy of flowers in Columns, written by pool's workers if given
+std::shared_ptr<Columns const> read_binned(std::string const &path, int bins); // codes of at most bins bins; empty if unreadable
+
+typedef std::array<Rows, 4> Orders; // rows sorted by each Feature, ties by row
+
+Rows   all_rows(std::size_t count); // 0 to count - 1
+template <class Value>
+std::size_t partition(std::uint32_t const *rows, std::size_t n, Value const *values, Value last, std::uint32_t *left, std::uint32_t *right);
+std::size_t partition(std::uint32_t const *rows, std::size_t n, double const *values, double last, std::uint32_t *left, std::uint32_t *right);
+Orders presort(Columns const &columns, Rows const &rows);
+
+class SortedColumns { // each Feature's order of all rows of a dataset, sorted once and kept in a cache directory
+	Orders               owned_;
+	void                *mapped_ = nullptr; // the cache file, when read back with mmap
+	std::size_t          bytes_ = 0;
+	std::uint32_t const *order_[4];
+	std::size_t          rows_;
+	bool                 hit_ = false;
+
+public:
+	SortedColumns(Columns const &columns, std::uint64_t key, std::string const &cache_dir); // no cache if cache_dir is empty
+	~SortedColumns();
+	SortedColumns(SortedColumns const &) = delete;
+	SortedColumns &operator=(SortedColumns const &) = delete;
+	bool   hit() const { return hit_; } // read from the cache
+	Orders without(std::size_t begin, std::size_t end) const; // the orders without rows begin to end - 1, still sorted
+};
+
+std::uint64_t fingerprint(Dataset const &flowers); // content hash identifying a dataset
+
+struct FlatNode { // a Node without its flowers; a leaf has feature < 0 and its Class in child[0]
+	double       threshold;
+	std::int32_t feature;
+	std::int32_t child[2]; // taken when the feature is below / not below threshold
+	std::int32_t cover;    // training flowers that reached the Node
+};
+
+struct PathElement { // a feature on the path TreeSHAP is walking, with the share of Shapley weight it carries
+	int    feature;
+	double zero; // fraction of cover flowing this way when the feature is left out
+	double one;  // whether the explained flower flows this way
+	double weight;
+};
+
+class ThreadPool { // workers pinned to cpus, with one task queue per NUMA node
+	std::vector<std::thread>                        workers_;
+	std::vector<std::deque<std::function<void()>>> queues_;
+	std::mutex                                      mutex_;
+	std::condition_variable                         ready_;
+	bool                                            stop_ = false;
+	static thread_local int                         numa_; // NUMA node of the calling thread; 0 outside the pool
+
+	bool pop(std::function<void()> &task); // takes a task, preferring the calling thread's node; requires mutex_
+	void work(int cpu, int numa);
+
+public:
+	explicit ThreadPool(int threads);
+	~ThreadPool();
+	std::future<void> submit(std::function<void()> task); // queues task on the calling thread's node, near the data it touched
+	void wait(std::future<void> &done); // runs queued tasks on the calling thread until done is ready
+};
+
+struct Progress { // shared by every Node of one background build
+	std::atomic<long> nodes{0};
+	std::atomic<int>  depth{0}; // longest position_ reached
+	std::atomic<bool> cancelled{false};
+};
+
+struct Params { // settings a Node is built with; its children inherit them
+	int           max_depth = 0; // length of position_ at which Nodes become leaves
+	int           min_leaf  = 1; // fewest flowers a split may leave on either side
+	Progress     *progress  = nullptr; // reported to and polled for cancellation, if set
+	std::uint64_t ties      = 0; // seeds the tie breaks of leaf Classes if set; otherwise they come from std::random_device
 };
 
 class Node {
+	friend class FlatTree;
+
 	std::string           feature_;
 	double                threshold_;
 	std::string           position_;
-	std::vector<Flower>   flowers_;
+	std::shared_ptr<Columns const> columns_; // the flowers of the whole tree
+	Orders                rows_;  // which of them reach this Node, in order of each Feature
 	std::unique_ptr<Node> left_;
 	std::unique_ptr<Node> right_;
-	
-	void   sort_flowers_by(Feature f);
-	void   count_class(int &a, int &b, int &c) const; // number of flowers at this Node of different Classes
-	double gain() const; // information gain at this Node
-	void   split_node(int index); // splits this Node into left and right, splits flowers at index
-	double max_gain(Feature f); // maximum possible gain at this Node for Feature f; updates all Node attributes
+	double                gain_ = 0; // information gain of this Node's split, from max_gain
+	int                   split_index_ = 0; // rows the last max_gain sends left
+	Params                params_;
+
+	struct Run { // rows of one value in an order
+		double              value;
+		std::int32_t        end;   // rows in the order up to and including this Run
+		std::int32_t const *count; // rows of each Class of each target, for classification
+		double              sum, squares; // of the response and its squares, for regression
+	};
+	struct Encoded { // the Runs of one Feature, stored only if it has few values for its rows
+		std::vector<double>       values;
+		std::vector<std::int32_t> ends;
+		std::vector<std::int32_t> counts; // 3 * targets per Run, for classification
+		std::vector<double>       sums;   // sum and sum of squares per Run, for regression
+	};
+	typedef std::array<Encoded, 4> Runs;
+	std::unique_ptr<Runs> runs_; // only while this Node is split; a Feature left empty is read from rows_
+
+	std::size_t read_run(Feature f, std::size_t i, std::int32_t *count, Run &run) const; // the Run starting at rows_[f][i]; returns its end
+	void   encode(Feature f); // stores the Runs of f in runs_ if there are at most one per run_rows rows
+	template <class Visit> void for_runs(Feature f, Visit visit) const; // visit(run) for each Run of f in order
+	void   count_class(int &a, int &b, int &c, int target = 0) const; // number of flowers at this Node of different Classes
+	static double gain(int a, int b, int c, int a1, int b1, int c1); // information gain of splitting a, b, c into a1, b1, c1 and the rest
+	static double reduction(int n, double sum, double squares, int n1, double sum1, double squares1); // the same for regression
+	void   split_node(Feature f, int index); // splits this Node into left and right at index in the order of f
+	double max_gain(Feature f); // maximum possible gain at this Node for Feature f; updates all Node attributes but the children
+	double bound(Feature f) const; // no split on f gains more; costs one step per Run, without a search
 	int    find_best(int a, int b, int c) const; // finds the best Class representative; breaks ties randomly
 	void   make_leaf();
+	bool   split(); // splits this Node on its best Feature, or makes it a leaf and returns false
 
 public:
-	Node(std::vector<Flower> const &new_flowers, std::string const &name) { flowers_ = new_flowers; position_ = name; }
-	void   set_max_depth(int depth) const { max_depth = depth + position_.size(); }
+	Node(std::shared_ptr<Columns const> columns, Orders rows, std::string const &name, Params const &params);
+	Node(std::shared_ptr<Columns const> columns, Rows const &rows, std::string const &name, Params const &params)
+		: Node(columns, presort(*columns, rows), name, params) {}
+	Node(std::shared_ptr<Columns const> columns, std::string const &name, Params const &params); // all rows of columns
+	Node(Flowers const &new_flowers, std::string const &name) : Node(new_flowers, name, Params()) {}
+	Node(Flowers const &new_flowers, std::string const &name, Params const &params)
+		: Node(columns_of(new_flowers.data(), new_flowers.size()), name, params) {}
+	void   set_max_depth(int depth) { params_.max_depth = depth + position_.size(); }
+	void   set_min_leaf(int flowers) { params_.min_leaf = flowers; }
 	void   print_tree() const;
-	void   build_tree();
+	void   build_tree(ThreadPool *pool = nullptr);
+	int    build_best_first(std::chrono::steady_clock::time_point deadline); // largest gains first; returns splits cut by the deadline
+	void   importance(double gain[4], int splits[4]) const; // adds each Feature's flower-weighted gain and splits in this subtree
+	int    simplify(); // turns splits whose children are leaves of one Class into leaves, bottom-up; returns Nodes removed
 	bool   validate_flower(Flower &f) const;
 };
 
+class Training { // handle to a tree being built on a ThreadPool
+	std::shared_ptr<Progress> progress_;
+	std::unique_ptr<Node>     root_;
+	std::future<void>         built_;
+	ThreadPool               *pool_;
+	int                       base_; // depth of the root's position_
+
+	void  stop(); // cancels a build still running and waits for it, since its Nodes point into this handle
+
+public:
+	Training(std::shared_ptr<Columns const> columns, Orders rows, Params params, std::string const &name, ThreadPool &pool);
+	Training(Training &&) = default;
+	Training(Training const &) = delete;
+	Training &operator=(Training &&other);
+	Training &operator=(Training const &) = delete;
+	~Training() { stop(); }
+	long  nodes() const { return progress_->nodes; }
+	int   depth() const { return std::max(0, progress_->depth - base_); }
+	void  cancel() { progress_->cancelled = true; } // splits already under way finish, the rest become leaves
+	bool  ready() const { return built_.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+	std::unique_ptr<Node> get(); // waits for the tree; empty if cancelled
+};
+
+Training train_async(std::shared_ptr<Columns const> columns, Orders rows, Params const &params, std::string const &name, ThreadPool &pool);
+Training train_async(std::shared_ptr<Columns const> columns, Params const &params, std::string const &name, ThreadPool &pool);
+Training train_async(Flower const *rows, std::size_t count, Params const &params, std::string const &name, ThreadPool &pool);
+
+typedef std::vector<std::vector<double>> Cuts; // sorted thresholds a model compares each Feature against
+
+class FlatTree { // a built tree laid out in one array for fast prediction
+	friend class Forest;
+
+	std::vector<FlatNode> nodes_;
+	long                  generation_;
+	double                importance_[4] = {}; // each Feature's split gain per training flower
+	int                   splits_[4] = {};
+
+	static int  height(Node const *n); // levels in the subtree at n
+	static void below(Node const *n, int depth, std::vector<Node const *> &order); // appends the Nodes depth levels under n
+	static void depth_first(Node const *n, std::vector<Node const *> &order);
+	static void breadth_first(Node const *n, std::vector<Node const *> &order);
+	static void van_emde_boas(Node const *n, int height, std::vector<Node const *> &order); // the top height levels at n
+	int intern(int at, std::vector<int> &canonical, std::map<std::tuple<double, int, int, int>, int> &seen);
+	int levels(int at) const; // levels in the subtree at nodes_[at]
+	bool well_formed() const; // a root, Features in range, and children inside the array that never lead back to a Node
+	void shap(Flower const &f, Class c, int at, PathElement *parent, int depth, double zero, double one, int feature, double phi[5]) const;
+	template <class Value, class Out> void walk(std::size_t n, Value value, Out out) const; // value(i, f) is row i's Feature f; out(i, leaf)
+
+public:
+	explicit FlatTree(Node const &root, Layout layout = dfs_layout);
+	explicit FlatTree(std::istream &in); // reads a tree written by save; sets failbit on in if it is not one
+	int    size() const { return nodes_.size(); }
+	void   share_subtrees(); // stores identical subtrees once, turning the tree into a DAG; shared covers no longer fit every copy
+	long   generation() const { return generation_; }
+	Cuts   cuts() const;
+	void   save(std::ostream &out) const;
+	double importance(Feature f) const { return importance_[f]; }
+	int    splits(Feature f) const { return splits_[f]; }
+	Class  predict(Flower const &f) const;
+	void   predict(Flower const *rows, std::size_t n, Class *out) const; // walks batch_rows rows at a time, one level per step
+	void   predict(Columns const &columns, std::int32_t *out) const;
+	void   predict(Columns const &columns, double *out) const; // a regression tree's leaf means
+	void   explain(Flower const &f, double phi[5]) const; // TreeSHAP values of each Feature, then the bias, for f's predicted Class
+	void   explain(Flower const *rows, std::size_t n, std::array<double, 5> *phi, ThreadPool *pool = nullptr) const;
+};
+
+class Forest { // trees packed into one array and walked forest_lanes at a time with vector gathers
+	std::vector<double>       threshold_; // a leaf's is +inf
+	std::vector<std::int32_t> feature_;
+	std::vector<std::int32_t> left_;      // the right child is left_ + 1; a leaf points to itself
+	std::vector<std::int8_t>  class_;     // a leaf's Class
+	std::vector<std::int32_t> roots_;
+	std::vector<int>          heights_;   // levels in each tree
+	double                    confidence_ = 0;
+	long                      generation_;
+	mutable std::atomic<long> rows_{0};   // rows predicted and trees walked for them
+	mutable std::atomic<long> walked_{0};
+
+	void walk(double const x[4], std::size_t first, int count[3]) const; // adds the Classes of trees first.. for x to count
+	bool decided(int const count[3], int walked) const; // whether the rest of the trees cannot, or need not, change the vote
+
+public:
+	Forest();
+	void   add(FlatTree const &tree);
+	int    size() const { return roots_.size(); }
+	void   set_confidence(double share) { confidence_ = share; } // also stop once the leader holds this share of the votes
+	double trees_per_row() const { return rows_ ? (double)walked_ / rows_ : 0; }
+	long   generation() const { return generation_; }
+	Cuts   cuts() const;
+	void   predict(Flower const *rows, std::size_t n, Class *out) const; // majority vote; ties go to the lower Class
+};
+
+struct Checkpoint { // where and how often forest training saves its progress
+	std::string path;      // none if empty
+	int         every = 8; // trees between saves
+	bool        resume = false;
+};
+
+class PredictionCache { // lock-striped CLOCK cache of predictions, keyed by the interval between cuts each feature falls in
+	struct Slot {
+		std::uint64_t key;
+		Class         prediction;
+		bool          referenced; // set on every hit; CLOCK evicts the first slot found clear
+	};
+	struct Stripe {
+		std::mutex                                     mutex;
+		std::vector<Slot>                              slots;
+		std::unordered_map<std::uint64_t, std::size_t> where;
+		std::size_t                                    hand = 0;
+		std::size_t                                    capacity; // the stripes' capacities add up to the cache's
+	};
+
+	std::unique_ptr<Stripe[]>        stripes_;
+	int                              stripe_count_;
+	std::shared_timed_mutex          model_mutex_; // held exclusively while switching to another model
+	long                             model_ = -1;  // generation the entries were computed by
+	Cuts                             cuts_;
+	int                              bits_[4];     // bits of the key holding each Feature's interval
+	bool                             keyable_;     // whether all intervals fit in 64 bits
+	std::atomic<long>                hits_{0};
+	std::atomic<long>                lookups_{0};
+
+	void          reset(Cuts const &cuts, long generation); // drops every entry; requires model_mutex_ exclusively
+	std::uint64_t key(Flower const &f) const;
+	Stripe       &stripe(std::uint64_t key) { return stripes_[(key * 0x9e3779b97f4a7c15ull >> 32) % stripe_count_]; }
+	bool          find(std::uint64_t key, Class &prediction);
+	void          insert(std::uint64_t key, Class prediction);
+
+public:
+	explicit PredictionCache(std::size_t capacity, int stripes = 16); // holds capacity entries, at least 1, over at most that many stripes
+	template <class Model>
+	void predict(Model const &model, Flower const *rows, std::size_t n, Class *out); // refreshes itself if model changed
+	long hits() const { return hits_; }
+	long lookups() const { return lookups_; }
+};
+
+template <class Model>
+class Cached { // a Model answering through a PredictionCache
+	Model const     &model_;
+	PredictionCache &cache_;
+
+public:
+	Cached(Model const &model, PredictionCache &cache) : model_(model), cache_(cache) {}
+	void predict(Flower const *rows, std::size_t n, Class *out) const { cache_.predict(model_, rows, n, out); }
+};
+
 double Flower::feature(Feature f) const {
 	switch (f) {
 		case SL: return sl_;
@@ -64,26 +500,336 @@ double Flower::feature(Feature f) const {
 	}
 }
 
-void Flower::read_from(std::string const &line) {
-	int c;
+template <class T, Buffer B>
+T *HugePageAllocator<T, B>::allocate(std::size_t n) {
+	std::size_t bytes = n * sizeof(T);
+	if (bytes < huge_page) return static_cast<T *>(::operator new(bytes));
+	page_stats[B].buffers++;
+#ifdef __linux__
+	std::size_t length = (bytes + huge_page - 1) / huge_page * huge_page;
+	void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED) {
+		page_stats[B].hugetlb++;
+		return static_cast<T *>(p);
+	}
+	p = mmap(nullptr, length + huge_page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) throw std::bad_alloc();
+	char *base    = static_cast<char *>(p);
+	char *aligned = base + (huge_page - reinterpret_cast<std::uintptr_t>(base) % huge_page) % huge_page;
+	if (aligned > base) munmap(base, aligned - base); // trim to a 2 MB boundary so THP can map whole pages
+	munmap(aligned + length, base + huge_page - aligned);
+	if (madvise(aligned, length, MADV_HUGEPAGE) == 0) page_stats[B].thp++;
+	return reinterpret_cast<T *>(aligned);
+#else
+	return static_cast<T *>(::operator new(bytes));
+#endif
+}
+
+template <class T, Buffer B>
+void HugePageAllocator<T, B>::deallocate(T *p, std::size_t n) {
+	std::size_t bytes = n * sizeof(T);
+#ifdef __linux__
+	if (bytes >= huge_page) {
+		munmap(p, (bytes + huge_page - 1) / huge_page * huge_page);
+		return;
+	}
+#endif
+	::operator delete(p);
+}
+
+bool Flower::read_from(std::string const &line) {
+	int c = -1;
 	char comma;
 	std::stringstream ss(line);
 	ss >> sl_ >> comma >> sw_ >> comma >> pl_ >> comma >> pw_ >> comma >> c;
 	class_ = (Class)c;
+	return !ss.fail() && c >= setosa && c <= virginica; // other Classes would index past the counts
 }
 
-void Node::sort_flowers_by(Feature f) {
-	return std::sort(flowers_.begin(), flowers_.end(), 
-		[f](Flower &f1, Flower &f2) -> bool {
-			return f1.feature(f) < f2.feature(f);
+thread_local int ThreadPool::numa_ = 0;
+
+ThreadPool::ThreadPool(int threads) {
+	std::vector<std::vector<int>> nodes = numa_cpus();
+	queues_.resize(nodes.size());
+	for (int i = 0; i < threads; i++) { // deal workers round-robin over nodes so every socket's memory bandwidth is used
+		int numa = i % nodes.size();
+		int cpu  = nodes[numa][(i / nodes.size()) % nodes[numa].size()];
+		workers_.emplace_back(&ThreadPool::work, this, cpu, numa);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	ready_.notify_all();
+	for (auto &w : workers_) w.join();
+}
+
+bool ThreadPool::pop(std::function<void()> &task) {
+	for (std::size_t i = 0; i < queues_.size(); i++) {
+		auto &q = queues_[(numa_ + i) % queues_.size()];
+		if (!q.empty()) {
+			task = std::move(q.front());
+			q.pop_front();
+			return true;
 		}
-	);
+	}
+	return false;
+}
+
+void ThreadPool::work(int cpu, int numa) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set); // pages this worker first-touches now land on its own node
+#endif
+	numa_ = numa;
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			ready_.wait(lock, [this, &task] { return pop(task) || stop_; });
+			if (!task) return;
+		}
+		task();
+	}
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task) {
+	auto job = std::make_shared<std::packaged_task<void()>>(std::move(task));
+	std::future<void> done = job->get_future();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queues_[numa_ % queues_.size()].emplace_back([job] { (*job)(); });
+	}
+	ready_.notify_one();
+	return done;
+}
+
+void ThreadPool::wait(std::future<void> &done) {
+	while (done.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		std::function<void()> task;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			pop(task);
+		}
+		if (task) task();
+		else done.wait(); // the task is running elsewhere; it never waits on us
+	}
+	done.get();
+}
+
+std::uint64_t fingerprint(Dataset const &flowers) {
+	std::uint64_t hash = 14695981039346656037ull; // FNV-1a over every value of every flower
+	for (auto &f : flowers) {
+		double values[5] = { f.feature(SL), f.feature(SW), f.feature(PL), f.feature(PW), (double)f.get_class() };
+		unsigned char bytes[sizeof(values)];
+		std::memcpy(bytes, values, sizeof(values));
+		for (auto b : bytes) hash = (hash ^ b) * 1099511628211ull;
+	}
+	return hash;
+}
+
+template <class T, class Value>
+void fill_column(Column<T> &column, std::size_t count, ThreadPool *pool, Value const &value) { // column[i] = value(i) for i < count
+	column.resize(count); // nothing written yet
+	std::size_t const slice = huge_page / sizeof(T); // slices start on page boundaries, so each page is first touched by one worker's node
+	std::vector<std::future<void>> done;
+	for (std::size_t begin = 0; begin < count; begin += slice) {
+		std::size_t end = std::min(count, begin + slice);
+		auto write = [&column, &value, begin, end] { for (std::size_t i = begin; i < end; i++) column[i] = value(i); };
+		if (pool && count > slice) done.push_back(pool->submit(write));
+		else write();
+	}
+	for (auto &d : done) pool->wait(d);
+}
+
+std::shared_ptr<Columns const> columns_of(Flower const *flowers, std::size_t count, ThreadPool *pool) {
+	struct Store {
+		Column<double>       values[4];
+		Column<std::int32_t> classes;
+		Columns              columns;
+	};
+	auto store = std::make_shared<Store>();
+	for (int f = 0; f < 4; f++) {
+		fill_column(store->values[f], count, pool, [flowers, f](std::size_t i) { return flowers[i].feature((Feature)f); });
+		store->columns.feature[f] = store->values[f].data();
+	}
+	fill_column(store->classes, count, pool, [flowers](std::size_t i) { return (std::int32_t)flowers[i].get_class(); });
+	store->columns.classes = store->classes.data();
+	store->columns.rows = count;
+	return std::shared_ptr<Columns const>(store, &store->columns); // shares ownership of the arrays
+}
+
+Rows all_rows(std::size_t count) {
+	Rows rows(count);
+	for (std::size_t i = 0; i < count; i++) rows[i] = i;
+	return rows;
+}
+
+Orders presort(Columns const &columns, Rows const &rows) {
+	Orders orders;
+	for (int f = 0; f < 4; f++) {
+		if (std::uint8_t const *codes = columns.codes[f]) { // counting sort; ties keep the order of rows
+			std::size_t starts[257] = {};
+			for (auto r : rows) starts[codes[r] + 1]++;
+			for (int c = 0; c < 256; c++) starts[c + 1] += starts[c];
+			orders[f].resize(rows.size());
+			for (auto r : rows) orders[f][starts[codes[r]]++] = r;
+			continue;
+		}
+		orders[f] = rows;
+		std::sort(orders[f].begin(), orders[f].end(), 
+			[f, &columns](std::uint32_t r1, std::uint32_t r2) -> bool {
+				double v1 = columns.value(r1, (Feature)f), v2 = columns.value(r2, (Feature)f);
+				return v1 < v2 || (v1 == v2 && r1 < r2);
+			}
+		);
+	}
+	return orders;
+}
+
+SortedColumns::SortedColumns(Columns const &columns, std::uint64_t key, std::string const &cache_dir) : rows_(columns.rows) {
+	std::uint64_t const magic = 0x3164726f2d746466ull; // "fdt-ord1"
+	std::uint64_t header[3] = {magic, key, rows_};
+	std::ostringstream name;
+	name << cache_dir << '/' << std::hex << std::setw(16) << std::setfill('0') << key << ".sorted";
+	std::string path = name.str();
+	bytes_ = sizeof(header) + 4 * rows_ * sizeof(std::uint32_t);
+	if (!cache_dir.empty()) {
+#ifdef __linux__
+		int fd = open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd >= 0 && fstat(fd, &st) == 0 && (std::size_t)st.st_size == bytes_) {
+			void *p = mmap(nullptr, bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED && std::memcmp(p, header, sizeof(header)) == 0) mapped_ = p;
+			else if (p != MAP_FAILED) munmap(p, bytes_);
+		}
+		if (fd >= 0) close(fd);
+#else
+		std::ifstream in(path, std::ios::binary);
+		std::uint64_t saved[3];
+		if (in.read((char *)saved, sizeof(saved)) && std::memcmp(saved, header, sizeof(header)) == 0) {
+			for (auto &o : owned_) {
+				o.resize(rows_);
+				in.read((char *)o.data(), rows_ * sizeof(std::uint32_t));
+			}
+			hit_ = bool(in);
+		}
+#endif
+	}
+	if (mapped_) {
+		hit_ = true;
+		auto *orders = (std::uint32_t const *)((char const *)mapped_ + sizeof(header));
+		for (int f = 0; f < 4; f++) order_[f] = orders + f * rows_;
+		return;
+	}
+	if (!hit_) {
+		owned_ = presort(columns, all_rows(rows_));
+		if (!cache_dir.empty()) { // written whole to a temporary file, then renamed, so readers never see part of one
+			std::ofstream out(path + ".tmp", std::ios::binary);
+			out.write((char const *)header, sizeof(header));
+			for (auto &o : owned_) out.write((char const *)o.data(), rows_ * sizeof(std::uint32_t));
+			out.close();
+			if (out) std::rename((path + ".tmp").c_str(), path.c_str());
+		}
+	}
+	for (int f = 0; f < 4; f++) order_[f] = owned_[f].data();
+}
+
+SortedColumns::~SortedColumns() {
+#ifdef __linux__
+	if (mapped_) munmap(mapped_, bytes_);
+#endif
 }
 
-void Node::count_class(int &a, int &b, int &c) const {
+Orders SortedColumns::without(std::size_t begin, std::size_t end) const {
+	Orders rows;
+	for (int f = 0; f < 4; f++) {
+		rows[f].reserve(rows_ - (end - begin));
+		std::copy_if(order_[f], order_[f] + rows_, std::back_inserter(rows[f]),
+			[begin, end](std::uint32_t r) { return r < begin || r >= end; });
+	}
+	return rows;
+}
+
+std::shared_ptr<Columns const> read_binned(std::string const &path, int bins) {
+	struct Store {
+		Column<std::uint8_t> codes[4]; // written as the second pass reads them
+		std::vector<double>  edges[4];
+		Column<std::int32_t> classes;
+		Columns              columns;
+	};
+	std::size_t const sample = 1 << 16; // values per Feature the quantiles are taken from
+	std::ifstream in(path);
+	if (!in) return nullptr;
+	std::vector<double> reservoir[4];
+	std::mt19937_64 g(1);
+	std::size_t rows = 0;
+	std::string line;
+	while (getline(in, line)) { // first pass: a uniform sample of each Feature
+		Flower f;
+		if (!f.read_from(line)) {
+			std::cerr << "Bad flower: " << line << std::endl;
+			return nullptr;
+		}
+		std::size_t slot = rows < sample ? rows : std::uniform_int_distribution<std::size_t>(0, rows)(g);
+		rows++;
+		for (int i = 0; i < 4; i++) {
+			if (slot == reservoir[i].size()) reservoir[i].push_back(f.feature((Feature)i));
+			else if (slot < sample) reservoir[i][slot] = f.feature((Feature)i);
+		}
+	}
+
+	if (rows > max_rows) {
+		std::cerr << "More than " << max_rows << " flowers" << std::endl;
+		return nullptr;
+	}
+	auto store = std::make_shared<Store>();
+	for (int i = 0; i < 4; i++) { // bins - 1 edges at the sample's quantiles, or between all its values if it has few
+		auto &r = reservoir[i];
+		auto &edges = store->edges[i];
+		std::sort(r.begin(), r.end());
+		std::vector<double> distinct(r);
+		distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+		if (distinct.size() <= (std::size_t)bins) edges.assign(distinct.begin() + std::min<std::size_t>(1, distinct.size()), distinct.end());
+		else for (int b = 1; b < bins; b++) edges.push_back(r[b * r.size() / bins]);
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+		reservoir[i] = std::vector<double>();
+		store->codes[i].reserve(rows);
+	}
+	store->classes.reserve(rows);
+	in.clear();
+	in.seekg(0);
+	while (getline(in, line)) { // second pass: codes straight into the columns
+		Flower f;
+		f.read_from(line); // checked by the first pass
+		for (int i = 0; i < 4; i++) {
+			auto &edges = store->edges[i];
+			store->codes[i].push_back(std::upper_bound(edges.begin(), edges.end(), f.feature((Feature)i)) - edges.begin());
+		}
+		store->classes.push_back(f.get_class());
+	}
+	for (int i = 0; i < 4; i++) {
+		store->columns.feature[i] = nullptr;
+		store->columns.codes[i] = store->codes[i].data();
+		store->columns.edges[i] = store->edges[i].data();
+	}
+	store->columns.classes = store->classes.data();
+	store->columns.rows = store->classes.size();
+	return std::shared_ptr<Columns const>(store, &store->columns);
+}
+
+Node::Node(std::shared_ptr<Columns const> columns, std::string const &name, Params const &params)
+	: Node(columns, presort(*columns, all_rows(columns->rows)), name, params) {}
+
+void Node::count_class(int &a, int &b, int &c, int target) const {
 	a = b = c = 0;
-	for (auto &f : flowers_) {
-		switch (f.get_class()) {
+	for (auto r : rows_[0]) {
+		switch (columns_->get_class(r, target)) {
 			case setosa:     a++;
 				break;
 			case versicolor: b++;
@@ -94,11 +840,8 @@ void Node::count_class(int &a, int &b, int &c) const {
 	}
 }
 
-double Node::gain() const {
-	int a, b, c, a1, b1, c1, a2, b2, c2;
-	count_class(a, b, c);
-	left_->count_class(a1, b1, c1);
-	right_->count_class(a2, b2, c2);
+double Node::gain(int a, int b, int c, int a1, int b1, int c1) {
+	int a2 = a-a1, b2 = b-b1, c2 = c-c1;
 	int total  = a+b+c;
 	int total1 = a1+b1+c1;
 	int total2 = a2+b2+c2;
@@ -108,34 +851,330 @@ double Node::gain() const {
 		- ((double)total2/total) * I((double)a2/total2, (double)b2/total2, (double)c2/total2);
 }
 
-void Node::split_node(int index) {
-	std::vector<Flower> lflowers(flowers_.begin(), flowers_.begin() + index);
-	std::vector<Flower> rflowers(flowers_.begin() + index, flowers_.end());
-	left_  = std::make_unique<Node>(lflowers, position_ + "L");
-	right_ = std::make_unique<Node>(rflowers, position_ + "R");
+Node::Node(std::shared_ptr<Columns const> columns, Orders rows, std::string const &name, Params const &params)
+	: position_(name), columns_(std::move(columns)), rows_(std::move(rows)), params_(params) {}
+
+std::size_t Node::read_run(Feature f, std::size_t i, std::int32_t *count, Run &run) const {
+	Rows const &rows = rows_[f];
+	double const *response = columns_->response;
+	run.value = columns_->value(rows[i], f);
+	run.sum = run.squares = 0;
+	std::fill(count, count + 3 * columns_->targets, 0);
+	for (; i < rows.size() && columns_->value(rows[i], f) == run.value; i++) {
+		if (response) {
+			run.sum     += response[rows[i]];
+			run.squares += response[rows[i]] * response[rows[i]];
+		} else {
+			for (int t = 0; t < columns_->targets; t++) count[3 * t + columns_->get_class(rows[i], t)]++;
+		}
+	}
+	run.end = i;
+	run.count = count;
+	return i;
 }
 
-double Node::max_gain(Feature f) {
-	sort_flowers_by(f);
-	int index = 1;
-	double cur_max = 0;
-	for (int split_point = 1; split_point < flowers_.size(); split_point++) {
-		for (; split_point < flowers_.size(); split_point++) {
-			if (flowers_[split_point-1].feature(f) != flowers_[split_point].feature(f)) {
-				break;
+void Node::encode(Feature f) {
+	Encoded &runs = (*runs_)[f];
+	std::size_t n = rows_[f].size();
+	int stride = columns_->response ? 0 : 3 * columns_->targets;
+	std::int32_t count[3 * max_targets];
+	Run run;
+	for (std::size_t i = 0; i < n; ) {
+		if ((runs.values.size() + 1) * run_rows > n) { // too many values to pay for storing them; read rows_ instead
+			runs = Encoded();
+			return;
+		}
+		i = read_run(f, i, count, run);
+		runs.values.push_back(run.value);
+		runs.ends.push_back(run.end);
+		runs.counts.insert(runs.counts.end(), count, count + stride);
+		if (columns_->response) {
+			runs.sums.push_back(run.sum);
+			runs.sums.push_back(run.squares);
+		}
+	}
+}
+
+template <class Visit>
+void Node::for_runs(Feature f, Visit visit) const {
+	Encoded const &runs = (*runs_)[f];
+	Run run;
+	if (!runs.values.empty()) {
+		int stride = 3 * columns_->targets;
+		for (std::size_t k = 0; k < runs.values.size(); k++) {
+			run.value   = runs.values[k];
+			run.end     = runs.ends[k];
+			run.count   = runs.counts.empty() ? nullptr : &runs.counts[k * stride];
+			run.sum     = runs.sums.empty() ? 0 : runs.sums[2 * k];
+			run.squares = runs.sums.empty() ? 0 : runs.sums[2 * k + 1];
+			visit(run);
+		}
+		return;
+	}
+	std::int32_t count[3 * max_targets];
+	for (std::size_t i = 0; i < rows_[f].size(); ) {
+		i = read_run(f, i, count, run);
+		visit(run);
+	}
+}
+
+double Node::reduction(int n, double sum, double squares, int n1, double sum1, double squares1) {
+	int n2 = n - n1;
+	double sum2 = sum - sum1, squares2 = squares - squares1;
+	if (n1 == 0 || n2 == 0) return 0;
+	double error = squares - sum*sum/n, error1 = squares1 - sum1*sum1/n1, error2 = squares2 - sum2*sum2/n2; // sums of squared errors
+	return std::max(0.0, (error - error1 - error2) / n); // per row, like gain; rounding may not push it below 0
+}
+
+double Node::bound(Feature f) const {
+	int n = rows_[f].size(), runs = 0, previous = 0;
+	if ((*runs_)[f].values.empty() && n > 0) return std::numeric_limits<double>::infinity(); // reading rows_ costs as much as the search
+	if (columns_->response) { // squared error within each Run stays in any split's children
+		double sum = 0, squares = 0, within = 0;
+		for_runs(f, [&](Run const &run) {
+			int rows = run.end - previous;
+			previous = run.end;
+			runs++;
+			sum += run.sum;
+			squares += run.squares;
+			within += run.squares - run.sum * run.sum / rows;
+		});
+		return runs < 2 ? 0 : std::max(0.0, (squares - sum * sum / n - within) / n);
+	}
+	auto entropy = [](int a, int b, int c) { // of a group of flowers, weighted by its size
+		int total = a + b + c;
+		return total ? total * I((double)a/total, (double)b/total, (double)c/total) : 0;
+	};
+	int targets = columns_->targets, total[3 * max_targets] = {};
+	double within[max_targets] = {};
+	for_runs(f, [&](Run const &run) {
+		runs++;
+		for (int c = 0; c < 3 * targets; c++) total[c] += run.count[c];
+		for (int t = 0; t < targets; t++) within[t] += entropy(run.count[3*t], run.count[3*t + 1], run.count[3*t + 2]);
+	});
+	if (runs < 2) return 0;
+	double most = 0;
+	for (int t = 0; t < targets; t++) { // children's entropy is at least that within the Runs, and at least that
+		int a = total[3*t], b = total[3*t + 1], c = total[3*t + 2]; // of the best grouping of whole Classes into two sides
+		double grouped = std::min({entropy(0, b, c), entropy(a, 0, c), entropy(a, b, 0)});
+		most += (entropy(a, b, c) - std::max(within[t], grouped)) / n;
+	}
+	return std::max(0.0, most);
+}
+
+template <class Value>
+std::size_t partition(std::uint32_t const *rows, std::size_t n, Value const *values, Value last, std::uint32_t *left, std::uint32_t *right) {
+	std::size_t sent = 0;
+	for (std::size_t i = 0; i < n; i++) { // both sides are written, so there is no branch to mispredict
+		bool goes_left = values[rows[i]] <= last;
+		left[sent] = right[i - sent] = rows[i];
+		sent += goes_left;
+	}
+	return sent;
+}
+
+std::size_t partition(std::uint32_t const *rows, std::size_t n, double const *values, double last, std::uint32_t *left, std::uint32_t *right) {
+	std::size_t i = 0, sent = 0;
+#if defined(__AVX512F__)
+	__m512d const bound = _mm512_set1_pd(last);
+	for (; i + 16 <= n; i += 16) { // gather 16 values, compare, and compress the rows to each side
+		__m512i r = _mm512_loadu_si512(rows + i);
+		__m512d low  = _mm512_i32gather_pd(_mm512_castsi512_si256(r), values, 8);
+		__m512d high = _mm512_i32gather_pd(_mm512_extracti64x4_epi64(r, 1), values, 8);
+		__mmask16 goes_left = _mm512_cmp_pd_mask(low, bound, _CMP_LE_OQ) | _mm512_cmp_pd_mask(high, bound, _CMP_LE_OQ) << 8;
+		_mm512_mask_compressstoreu_epi32(left + sent, goes_left, r);
+		_mm512_mask_compressstoreu_epi32(right + i - sent, ~goes_left, r);
+		sent += __builtin_popcount(goes_left);
+	}
+#elif defined(__AVX2__)
+	static auto const packs = [] { // for each mask of 8 lanes, the lanes it selects, first to last
+		std::array<std::array<std::int32_t, 8>, 256> packs{};
+		for (int m = 0; m < 256; m++) {
+			for (int lane = 0, k = 0; lane < 8; lane++) {
+				if (m >> lane & 1) packs[m][k++] = lane;
+			}
+		}
+		return packs;
+	}();
+	__m256d const bound = _mm256_set1_pd(last);
+	for (; i + 8 <= n; i += 8) { // load 8 values, compare, and shuffle the rows to each side; the full stores spill into the slack
+		__m256i r = _mm256_loadu_si256((__m256i const *)(rows + i));
+		std::uint32_t const *at = rows + i; // separate loads, as AVX2 gathers are slower than them on many cores
+		__m256d low  = _mm256_setr_pd(values[at[0]], values[at[1]], values[at[2]], values[at[3]]);
+		__m256d high = _mm256_setr_pd(values[at[4]], values[at[5]], values[at[6]], values[at[7]]);
+		int goes_left = _mm256_movemask_pd(_mm256_cmp_pd(low, bound, _CMP_LE_OQ)) | _mm256_movemask_pd(_mm256_cmp_pd(high, bound, _CMP_LE_OQ)) << 4;
+		__m256i to_left  = _mm256_loadu_si256((__m256i const *)packs[goes_left].data());
+		__m256i to_right = _mm256_loadu_si256((__m256i const *)packs[~goes_left & 255].data());
+		_mm256_storeu_si256((__m256i *)(left + sent), _mm256_permutevar8x32_epi32(r, to_left));
+		_mm256_storeu_si256((__m256i *)(right + i - sent), _mm256_permutevar8x32_epi32(r, to_right));
+		sent += __builtin_popcount(goes_left);
+	}
+#endif
+	return sent + partition<double>(rows + i, n - i, values, last, left + sent, right + i - sent);
+}
+
+void Node::split_node(Feature f, int index) { // every order splits stably, so the children need neither sorting nor merging
+	Orders left, right;
+	double last = columns_->value(rows_[f][index-1], f); // the largest value going left
+	for (int g = 0; g < 4; g++) {
+		Rows const &rows = rows_[g];
+		if (g == f) { // already in the order of the split
+			left[g].assign(rows.begin(), rows.begin() + index);
+			right[g].assign(rows.begin() + index, rows.end());
+		} else {
+			left[g].resize(index + partition_slack);
+			right[g].resize(rows.size() - index + partition_slack);
+			if (std::uint8_t const *codes = columns_->codes[f]) partition(rows.data(), rows.size(), codes, (std::uint8_t)last, left[g].data(), right[g].data());
+			else partition(rows.data(), rows.size(), columns_->feature[f], last, left[g].data(), right[g].data());
+			left[g].resize(index);
+			right[g].resize(rows.size() - index);
+		}
+	}
+	left_  = std::make_unique<Node>(columns_, std::move(left), position_ + "L", params_);
+	right_ = std::make_unique<Node>(columns_, std::move(right), position_ + "R", params_);
+}
+
+struct Candidates { // the split points max_gain scores, each with the Class counts and response sums to its left
+	std::vector<int>          points;
+	std::vector<double>       lows, highs; // values of the Runs on either side of each point
+	std::vector<std::int32_t> counts[3 * max_targets];
+	std::vector<double>       sums, squares;
+	std::vector<float>        approx; // approximate gains, summed over the targets
+
+	void clear() {
+		points.clear();
+		lows.clear();
+		highs.clear();
+		for (auto &c : counts) c.clear();
+		sums.clear();
+		squares.clear();
+	}
+};
+
+inline float xlog2x(float x) { // x log2 x for a count, from its exponent and a short series for the mantissa; 0 for 0
+	std::int32_t bits;
+	std::memcpy(&bits, &x, sizeof(x));
+	std::int32_t e = (bits - 0x3f3504f3) >> 23; // x = m 2^e with m in [sqrt(1/2), sqrt(2))
+	bits -= e * (1 << 23);
+	float m;
+	std::memcpy(&m, &bits, sizeof(m));
+	float s = (m - 1) / (m + 1), z = s * s; // log2 m = 2/ln 2 (s + s^3/3 + ...), and |s| < 0.172
+	return x * (e + s * (2.8853901f + z * (0.96179669f + z * (0.57707802f + z * 0.41219858f))));
+}
+
+#if defined(__AVX2__)
+inline __m256 xlog2x(__m256 x) { // the same for 8 counts
+	__m256i bits = _mm256_castps_si256(x);
+	__m256i e = _mm256_srai_epi32(_mm256_sub_epi32(bits, _mm256_set1_epi32(0x3f3504f3)), 23);
+	__m256 m = _mm256_castsi256_ps(_mm256_sub_epi32(bits, _mm256_slli_epi32(e, 23)));
+	__m256 one = _mm256_set1_ps(1);
+	__m256 s = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one)), z = _mm256_mul_ps(s, s);
+	__m256 series = _mm256_add_ps(_mm256_set1_ps(0.57707802f), _mm256_mul_ps(z, _mm256_set1_ps(0.41219858f)));
+	series = _mm256_add_ps(_mm256_set1_ps(0.96179669f), _mm256_mul_ps(z, series));
+	series = _mm256_add_ps(_mm256_set1_ps(2.8853901f), _mm256_mul_ps(z, series));
+	return _mm256_mul_ps(x, _mm256_add_ps(_mm256_cvtepi32_ps(e), _mm256_mul_ps(s, series)));
+}
+#endif
+
+// adds to gains[k] the approximate information gain of splitting a, b, c into a1[k], b1[k], c1[k] and the rest
+void approx_gains(int a, int b, int c, std::int32_t const *a1, std::int32_t const *b1, std::int32_t const *c1, std::size_t m, float *gains) {
+	int n = a + b + c;
+	float parent = (float)(linlog(n) - linlog(a) - linlog(b) - linlog(c)), scale = 1.0f / n; // gains in counts times log2, over n
+	std::size_t k = 0;
+#if defined(__AVX2__)
+	__m256i const ta = _mm256_set1_epi32(a), tb = _mm256_set1_epi32(b), tc = _mm256_set1_epi32(c), tn = _mm256_set1_epi32(n);
+	for (; k + 8 <= m; k += 8) {
+		__m256i la = _mm256_loadu_si256((__m256i const *)(a1 + k));
+		__m256i lb = _mm256_loadu_si256((__m256i const *)(b1 + k));
+		__m256i lc = _mm256_loadu_si256((__m256i const *)(c1 + k));
+		__m256i ln = _mm256_add_epi32(_mm256_add_epi32(la, lb), lc);
+		__m256 left  = _mm256_sub_ps(xlog2x(_mm256_cvtepi32_ps(ln)), _mm256_add_ps(_mm256_add_ps(xlog2x(_mm256_cvtepi32_ps(la)),
+			xlog2x(_mm256_cvtepi32_ps(lb))), xlog2x(_mm256_cvtepi32_ps(lc))));
+		__m256 right = _mm256_sub_ps(xlog2x(_mm256_cvtepi32_ps(_mm256_sub_epi32(tn, ln))), _mm256_add_ps(_mm256_add_ps(
+			xlog2x(_mm256_cvtepi32_ps(_mm256_sub_epi32(ta, la))), xlog2x(_mm256_cvtepi32_ps(_mm256_sub_epi32(tb, lb)))),
+			xlog2x(_mm256_cvtepi32_ps(_mm256_sub_epi32(tc, lc)))));
+		__m256 gain = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(parent), left), right), _mm256_set1_ps(scale));
+		_mm256_storeu_ps(gains + k, _mm256_add_ps(_mm256_loadu_ps(gains + k), gain));
+	}
+#endif
+	for (; k < m; k++) {
+		int a2 = a - a1[k], b2 = b - b1[k], c2 = c - c1[k];
+		float left  = xlog2x(a1[k] + b1[k] + c1[k]) - (xlog2x(a1[k]) + xlog2x(b1[k]) + xlog2x(c1[k]));
+		float right = xlog2x(a2 + b2 + c2) - (xlog2x(a2) + xlog2x(b2) + xlog2x(c2));
+		gains[k] += (parent - left - right) * scale;
+	}
+}
+
+double Node::max_gain(Feature f) { // one step per Run rather than per row; the candidates are scored together, then the best rescored exactly
+	static thread_local Candidates candidates;
+	if (rows_[f].empty()) return 0; // no flowers reach this Node
+	bool regression = columns_->response;
+	int size = rows_[f].size(), classes = regression ? 0 : 3 * columns_->targets;
+	int counts[3 * max_targets] = {}; // counts of each Class of each target in the Runs so far
+	double sum = 0, squares = 0;      // and sums of the response
+	int next = 1, end = 0; // a candidate at split_point resumes the search at split_point + 2
+	std::size_t runs = 0;
+	double values[2] = {}, low = 0; // of the first two Runs, and of the last
+	candidates.clear();
+	for_runs(f, [&](Run const &run) {
+		if (runs < 2) values[runs] = run.value;
+		int split_point = end; // between the Runs before and this one
+		if (runs++ > 0 && split_point >= next) {
+			next = split_point + 2;
+			if (split_point >= params_.min_leaf && size - split_point >= params_.min_leaf) {
+				candidates.points.push_back(split_point);
+				candidates.lows.push_back(low);
+				candidates.highs.push_back(run.value);
+				for (int c = 0; c < classes; c++) candidates.counts[c].push_back(counts[c]);
+				if (regression) {
+					candidates.sums.push_back(sum);
+					candidates.squares.push_back(squares);
+				}
 			}
 		}
-		split_node(split_point);
-		double candidate = gain();
+		for (int c = 0; c < classes; c++) counts[c] += run.count[c];
+		sum += run.sum;
+		squares += run.squares;
+		low = run.value;
+		end = run.end;
+	});
+	int const *total = counts; // every Run has been counted
+
+	std::size_t m = candidates.points.size();
+	bool screened = !regression && size < 1 << 24 && m > 1; // counts stay exact as floats
+	float floor = 0; // screened candidates scoring below it cannot be the best
+	if (screened) {
+		candidates.approx.assign(m, 0);
+		for (int t = 0; t < classes; t += 3) {
+			approx_gains(total[t], total[t+1], total[t+2], candidates.counts[t].data(), candidates.counts[t+1].data(), candidates.counts[t+2].data(), m, candidates.approx.data());
+		}
+		float top = -std::numeric_limits<float>::infinity();
+		for (float g : candidates.approx) top = std::max(top, g);
+		floor = top - 2 * approx_gain_error * columns_->targets;
+	}
+	int index = 1;
+	double cur_max = 0, lowest = values[0], highest = values[1]; // the Runs either side of the best split; the first two if none gains
+	for (std::size_t k = 0; k < m; k++) {
+		if (screened && candidates.approx[k] < floor) continue;
+		double candidate;
+		if (regression) {
+			candidate = reduction(size, sum, squares, candidates.points[k], candidates.sums[k], candidates.squares[k]);
+		} else {
+			auto const &count = candidates.counts;
+			candidate = gain(total[setosa], total[versicolor], total[virginica], count[setosa][k], count[versicolor][k], count[virginica][k]);
+			for (int t = 3; t < classes; t += 3) candidate += gain(total[t], total[t+1], total[t+2], count[t][k], count[t+1][k], count[t+2][k]);
+		}
 		if (candidate > cur_max) {
 			cur_max = candidate;
-			index = split_point;
+			index = candidates.points[k];
+			lowest = candidates.lows[k];
+			highest = candidates.highs[k];
 		}
-		split_point++;
 	}
 
-	split_node(index);
-	threshold_ = (flowers_[index-1].feature(f) + flowers_[index].feature(f)) / 2;
+	split_index_ = index;
+	threshold_ = runs > 1 ? (lowest + highest) / 2 : lowest;
+	if (columns_->codes[f] && runs > 1) threshold_ = columns_->edges[f][(int)lowest]; // the first value of the next bin
 	switch (f) {
 		case SL: feature_ = "SL";
 			break;
@@ -152,6 +1191,10 @@ double Node::max_gain(Feature f) {
 int Node::find_best(int a, int b, int c) const {
 	std::random_device rd;
 	std::mt19937 g(rd());
+	if (std::uint64_t h = params_.ties) {
+		for (char p : position_) h = (h ^ (unsigned char)p) * 1099511628211ull; // FNV-1a over the path, so each leaf draws its own
+		g.seed(h ^ h >> 32);
+	}
 	std::uniform_int_distribution<int> d2(0, 2);
 	std::uniform_int_distribution<int> d1(0, 1);
 	if (a == b && b == c)     return d2(g);
@@ -167,53 +1210,194 @@ int Node::find_best(int a, int b, int c) const {
 void Node::make_leaf() {
 	left_.reset();
 	right_.reset();
-	int a, b, c;
-	count_class(a, b, c);
-	feature_ = std::to_string(find_best(a, b, c));
+	gain_ = 0;
+	if (double const *response = columns_->response) { // a regression leaf is "0" and holds its mean as the threshold
+		double sum = 0;
+		for (auto r : rows_[0]) sum += response[r];
+		feature_ = "0";
+		threshold_ = rows_[0].empty() ? 0 : sum / rows_[0].size();
+		return;
+	}
+	int packed = 0; // each target's Class in base 3, as Columns::label
+	for (int t = columns_->targets - 1; t >= 0; t--) {
+		int a, b, c;
+		count_class(a, b, c, t);
+		packed = 3 * packed + find_best(a, b, c);
+	}
+	feature_ = std::to_string(packed);
 	threshold_ = 0;
 }
 
-void Node::print_tree() const {
+void Node::print_tree() const { // flowers in order of SL, ties in the order they were read; a binned value prints as its bin's lower edge
 	std::cout << std::endl << "Node ID:\t" << feature_ << std::endl;
 	std::cout << std::setprecision(2) << std::fixed <<  "Threshold:\t" << threshold_ << std::endl;
 	std::cout << "Position:\t" << (position_ == "" ? "Root" : position_) << std::endl;
-	for (auto &f : flowers_) {
-		std::cout << std::setprecision(1) << std::fixed << f.feature(SL) << ',' << f.feature(SW) << ',' 
-			<< f.feature(PL) << ',' << f.feature(PW) << ',' << (double)f.get_class() << std::endl;
+	for (auto r : rows_[0]) {
+		std::cout << std::setprecision(1) << std::fixed << columns_->lowest(r, SL) << ',' << columns_->lowest(r, SW) << ',' 
+			<< columns_->lowest(r, PL) << ',' << columns_->lowest(r, PW) << ',' << (columns_->response ? columns_->response[r] : (double)columns_->get_class(r)) << std::endl;
 	}
 	if (left_)  left_->print_tree();
 	if (right_) right_->print_tree();
 }
 
-void Node::build_tree() {
-	for (int i = 0; i <= flowers_.size()-1; i++) {
-		if (i == flowers_.size()-1 /* all examples same */|| max_depth == position_.size() /* reached maximum depth */) {
+bool Node::split() {
+	if (Progress *p = params_.progress) {
+		p->nodes++;
+		for (int d = p->depth; d < (int)position_.size() && !p->depth.compare_exchange_weak(d, position_.size()); );
+		if (p->cancelled) {
 			make_leaf();
-			return;
+			return false;
+		}
+	}
+	for (int i = 0; i <= rows_[0].size()-1; i++) {
+		if (i == rows_[0].size()-1 /* all examples same */|| params_.max_depth == position_.size() /* reached maximum depth */) {
+			make_leaf();
+			return false;
 		}
-		if (flowers_[i].get_class() != flowers_[i+1].get_class()) break;
+		if (!columns_->agree(rows_[0][i], rows_[0][i+1])) break;
 	}
 
-	double gainSL = max_gain(SL);
-	double gainSW = max_gain(SW);
-	double gainPL = max_gain(PL);
-	double gainPW = max_gain(PW);
+	double gains[4] = {}, bounds[4], thresholds[4] = {}, best = 0;
+	int indices[4] = {};
+	Feature order[4] = {SL, SW, PL, PW};
+	runs_ = std::make_unique<Runs>(); // freed below, so only Nodes being split hold Runs
+	for (auto f : order) encode(f);
+	for (auto f : order) bounds[f] = bound(f);
+	std::sort(order, order + 4, [&bounds](Feature f1, Feature f2) { return bounds[f1] > bounds[f2]; });
+	for (auto f : order) { // a Feature whose bound is below the best gain so far can't win, so it keeps gain 0
+		if (bounds[f] + 1e-9 < best) continue; // the margin covers rounding between bound and max_gain
+		gains[f] = max_gain(f);
+		indices[f] = split_index_;
+		thresholds[f] = threshold_;
+		best = std::max(best, gains[f]);
+	}
+	auto chosen = [&](Feature f) { // the split max_gain found for f, without searching again
+		split_index_ = indices[f];
+		threshold_ = thresholds[f];
+		feature_ = feature_names[f];
+		return gains[f];
+	};
+	double gainSL = gains[SL];
+	double gainSW = gains[SW];
+	double gainPL = gains[PL];
+	double gainPW = gains[PW];
 	double gain = 0;
 	if (gainSL == 0 && gainSW == 0 && gainPL == 0 && gainPW == 0) { // no feature left
 		make_leaf();
-		return;
+		runs_.reset();
+		return false;
 	} else if (gainSL >= gainSW && gainSL >= gainPL && gainSL >= gainPW) {
-		gain = max_gain(SL);
+		gain = chosen(SL);
 	} else if (gainSW >= gainSL && gainSW >= gainPL && gainSW >= gainPW) {
-		gain = max_gain(SW);
+		gain = chosen(SW);
 	} else if (gainPL >= gainSL && gainPL >= gainSW && gainPL >= gainPW) {
-		gain = max_gain(PL);
+		gain = chosen(PL);
 	} else {
-		gain = max_gain(PW);
+		gain = chosen(PW);
 	}
+	gain_ = gain;
+	split_node((Feature)feature_of(feature_), split_index_);
+	runs_.reset();
+	return true;
+}
+
+void Node::build_tree(ThreadPool *pool) {
+	if (!split()) return;
+	if (pool && rows_[0].size() >= parallel_rows) { // the left subtree runs on this worker's node, where its rows were copied
+		std::future<void> left = pool->submit([this, pool] { left_->build_tree(pool); });
+		right_->build_tree(pool);
+		pool->wait(left);
+	} else {
+		left_->build_tree(pool);
+		right_->build_tree(pool);
+	}
+}
+
+Training::Training(std::shared_ptr<Columns const> columns, Orders rows, Params params, std::string const &name, ThreadPool &pool)
+	: progress_(std::make_shared<Progress>()), pool_(&pool), base_(name.size()) {
+	params.progress = progress_.get();
+	root_ = std::make_unique<Node>(std::move(columns), std::move(rows), name, params);
+	Node *root = root_.get();
+	built_ = pool.submit([root, &pool] { root->build_tree(&pool); });
+}
+
+void Training::stop() {
+	if (!built_.valid()) return; // moved from, or already waited for
+	cancel();
+	pool_->wait(built_);
+}
+
+Training &Training::operator=(Training &&other) {
+	if (this == &other) return *this;
+	stop();
+	progress_ = std::move(other.progress_);
+	root_     = std::move(other.root_);
+	built_    = std::move(other.built_);
+	pool_     = other.pool_;
+	base_     = other.base_;
+	return *this;
+}
+
+std::unique_ptr<Node> Training::get() {
+	pool_->wait(built_);
+	if (progress_->cancelled) root_.reset();
+	return std::move(root_);
+}
+
+Training train_async(std::shared_ptr<Columns const> columns, Orders rows, Params const &params, std::string const &name, ThreadPool &pool) {
+	return Training(std::move(columns), std::move(rows), params, name, pool);
+}
 
-	left_->build_tree();
-	right_->build_tree();
+Training train_async(std::shared_ptr<Columns const> columns, Params const &params, std::string const &name, ThreadPool &pool) {
+	Orders rows = presort(*columns, all_rows(columns->rows));
+	return Training(std::move(columns), std::move(rows), params, name, pool);
+}
+
+Training train_async(Flower const *rows, std::size_t count, Params const &params, std::string const &name, ThreadPool &pool) {
+	return train_async(columns_of(rows, count, &pool), params, name, pool);
+}
+
+void Node::importance(double gain[4], int splits[4]) const {
+	if (!left_) return;
+	int f = feature_of(feature_);
+	gain[f] += gain_ * rows_[0].size();
+	splits[f]++;
+	left_->importance(gain, splits);
+	right_->importance(gain, splits);
+}
+
+int Node::build_best_first(std::chrono::steady_clock::time_point deadline) {
+	std::priority_queue<std::pair<double, Node *>> frontier; // Nodes with a split chosen but not yet kept, by flowers' total gain
+	auto consider = [&frontier](Node *n) {
+		if (n->split()) {
+			frontier.emplace(n->gain_ * n->rows_[0].size(), n);
+			n->left_->make_leaf(); // until it is kept, the split hangs off a valid tree
+			n->right_->make_leaf();
+		}
+	};
+	consider(this);
+	while (!frontier.empty() && std::chrono::steady_clock::now() < deadline) {
+		Node *n = frontier.top().second;
+		frontier.pop();
+		consider(n->left_.get());
+		consider(n->right_.get());
+	}
+	int cut = frontier.size();
+	for (; !frontier.empty(); frontier.pop()) frontier.top().second->make_leaf();
+	return cut;
+}
+
+int Node::simplify() {
+	if (!left_) return 0;
+	int removed = left_->simplify() + right_->simplify();
+	if (!left_->left_ && !right_->left_ && left_->feature_ == right_->feature_ && left_->threshold_ == right_->threshold_) {
+		feature_   = left_->feature_;
+		threshold_ = left_->threshold_;
+		left_.reset();
+		right_.reset();
+		removed += 2;
+	}
+	return removed;
 }
 
 bool Node::validate_flower(Flower &f) const {
@@ -234,37 +1418,1112 @@ bool Node::validate_flower(Flower &f) const {
 	}
 }
 
+FlatTree::FlatTree(Node const &root, Layout layout) : generation_(++generations) {
+	std::vector<Node const *> order;
+	switch (layout) {
+		case dfs_layout: depth_first(&root, order);
+			break;
+		case bfs_layout: breadth_first(&root, order);
+			break;
+		case veb_layout: van_emde_boas(&root, height(&root), order);
+			break;
+	}
+	std::unordered_map<Node const *, int> index;
+	for (std::size_t i = 0; i < order.size(); i++) index[order[i]] = i;
+	for (auto n : order) {
+		FlatNode node{n->threshold_, feature_of(n->feature_), {0, 0}, (std::int32_t)n->rows_[0].size()};
+		if (n->left_) {
+			node.child[0] = index[n->left_.get()];
+			node.child[1] = index[n->right_.get()];
+		} else {
+			node.child[0] = std::stoi(n->feature_);
+		}
+		nodes_.push_back(node);
+	}
+	root.importance(importance_, splits_);
+	for (auto &i : importance_) i /= root.rows_[0].size();
+}
+
+int FlatTree::height(Node const *n) {
+	return n->left_ ? 1 + std::max(height(n->left_.get()), height(n->right_.get())) : 1;
+}
+
+void FlatTree::below(Node const *n, int depth, std::vector<Node const *> &order) {
+	if (depth == 0) order.push_back(n);
+	else if (n->left_) {
+		below(n->left_.get(), depth - 1, order);
+		below(n->right_.get(), depth - 1, order);
+	}
+}
+
+void FlatTree::depth_first(Node const *n, std::vector<Node const *> &order) {
+	order.push_back(n);
+	if (n->left_) {
+		depth_first(n->left_.get(), order);
+		depth_first(n->right_.get(), order);
+	}
+}
+
+void FlatTree::breadth_first(Node const *n, std::vector<Node const *> &order) {
+	order.push_back(n);
+	for (std::size_t i = order.size() - 1; i < order.size(); i++) {
+		if (order[i]->left_) {
+			order.push_back(order[i]->left_.get());
+			order.push_back(order[i]->right_.get());
+		}
+	}
+}
+
+void FlatTree::van_emde_boas(Node const *n, int height, std::vector<Node const *> &order) {
+	if (height == 1) {
+		order.push_back(n);
+		return;
+	}
+	int top = height / 2; // lay out the top half as one block, then each subtree hanging off it as a block
+	van_emde_boas(n, top, order);
+	std::vector<Node const *> bottoms;
+	below(n, top, bottoms);
+	for (auto b : bottoms) van_emde_boas(b, height - top, order);
+}
+
+void FlatTree::share_subtrees() {
+	std::vector<int> canonical(nodes_.size(), -1);
+	std::map<std::tuple<double, int, int, int>, int> seen;
+	intern(0, canonical, seen);
+	std::vector<int> index(nodes_.size(), -1);
+	std::vector<FlatNode> shared;
+	for (std::size_t i = 0; i < nodes_.size(); i++) { // keep the first copy of each subtree, in layout order
+		if (canonical[i] == (int)i) {
+			index[i] = shared.size();
+			shared.push_back(nodes_[i]);
+		}
+	}
+	for (auto &node : shared) {
+		if (node.feature >= 0) {
+			node.child[0] = index[canonical[node.child[0]]];
+			node.child[1] = index[canonical[node.child[1]]];
+		}
+	}
+	nodes_ = shared;
+	generation_ = ++generations;
+}
+
+int FlatTree::intern(int at, std::vector<int> &canonical, std::map<std::tuple<double, int, int, int>, int> &seen) {
+	FlatNode const &node = nodes_[at];
+	std::tuple<double, int, int, int> key(node.threshold, -1, node.child[0], 0); // a leaf is its Class, or its mean for regression
+	if (node.feature >= 0) {
+		int left  = intern(node.child[0], canonical, seen);
+		int right = intern(node.child[1], canonical, seen);
+		key = std::make_tuple(node.threshold, node.feature, left, right);
+	}
+	return canonical[at] = seen.emplace(key, at).first->second;
+}
+
+FlatTree::FlatTree(std::istream &in) : generation_(++generations) {
+	std::size_t size = 0;
+	in >> size;
+	nodes_.resize(size);
+	for (auto &node : nodes_) in >> node.feature >> node.threshold >> node.child[0] >> node.child[1] >> node.cover;
+	std::string tag;
+	in >> tag;
+	for (auto &i : importance_) in >> i;
+	for (auto &s : splits_) in >> s;
+	if (tag != "importance" || !well_formed()) in.setstate(std::ios::failbit);
+}
+
+bool FlatTree::well_formed() const {
+	if (nodes_.empty()) return false;
+	std::vector<int> parents(nodes_.size()); // split Nodes pointing at each Node
+	for (auto &node : nodes_) {
+		if (node.feature < 0) continue;
+		if (node.feature > PW) return false;
+		for (int c : node.child) {
+			if (c < 0 || c >= (int)nodes_.size()) return false;
+			parents[c]++;
+		}
+	}
+	std::vector<int> ready; // Nodes whose parents have all been removed; each removal frees its children
+	for (std::size_t i = 0; i < nodes_.size(); i++) {
+		if (parents[i] == 0) ready.push_back(i);
+	}
+	std::size_t removed = 0;
+	while (!ready.empty()) {
+		FlatNode const &node = nodes_[ready.back()];
+		ready.pop_back();
+		removed++;
+		if (node.feature < 0) continue;
+		for (int c : node.child) {
+			if (--parents[c] == 0) ready.push_back(c);
+		}
+	}
+	return removed == nodes_.size(); // otherwise some Nodes lie on a cycle
+}
+
+void FlatTree::save(std::ostream &out) const {
+	auto precision = out.precision(17); // enough digits to read back every threshold exactly
+	out << nodes_.size() << '\n';
+	for (auto &node : nodes_) {
+		out << node.feature << ' ' << node.threshold << ' ' << node.child[0] << ' ' << node.child[1] << ' ' << node.cover << '\n';
+	}
+	out << "importance";
+	for (auto i : importance_) out << ' ' << i;
+	for (auto s : splits_) out << ' ' << s;
+	out << '\n';
+	out.precision(precision);
+}
+
+Cuts FlatTree::cuts() const {
+	Cuts cuts(4);
+	for (auto &node : nodes_) {
+		if (node.feature >= 0) cuts[node.feature].push_back(node.threshold);
+	}
+	for (auto &c : cuts) {
+		std::sort(c.begin(), c.end());
+		c.erase(std::unique(c.begin(), c.end()), c.end());
+	}
+	return cuts;
+}
+
+int FlatTree::levels(int at) const {
+	FlatNode const &node = nodes_[at];
+	return node.feature < 0 ? 1 : 1 + std::max(levels(node.child[0]), levels(node.child[1]));
+}
+
+void FlatTree::explain(Flower const &f, double phi[5]) const {
+	std::fill(phi, phi + 5, 0.0);
+	Class c = predict(f);
+	int depth = levels(0);
+	std::vector<PathElement> paths((depth + 2) * (depth + 3) / 2); // one path per level, each a step longer than its parent's
+	shap(f, c, 0, paths.data(), 0, 1, 1, -1, phi);
+	std::vector<std::pair<int, double>> pending{{0, 1.0}}; // the bias is the cover-weighted share of leaves voting c
+	for (std::size_t i = 0; i < pending.size(); i++) {
+		FlatNode const &node = nodes_[pending[i].first];
+		if (node.feature < 0) phi[4] += (node.child[0] == c) * pending[i].second;
+		else {
+			for (int side = 0; side < 2; side++) {
+				pending.emplace_back(node.child[side], pending[i].second * nodes_[node.child[side]].cover / node.cover);
+			}
+		}
+	}
+}
+
+void FlatTree::explain(Flower const *rows, std::size_t n, std::array<double, 5> *phi, ThreadPool *pool) const {
+	std::vector<std::future<void>> done;
+	for (std::size_t first = 0; first < n; first += parallel_rows) {
+		auto chunk = [this, rows, n, phi, first] {
+			for (std::size_t i = first; i < std::min(n, first + parallel_rows); i++) explain(rows[i], phi[i].data());
+		};
+		if (pool) done.push_back(pool->submit(chunk));
+		else chunk();
+	}
+	for (auto &d : done) pool->wait(d);
+}
+
+void FlatTree::shap(Flower const &f, Class c, int at, PathElement *parent, int depth, double zero, double one, int feature, double phi[5]) const {
+	PathElement *path = parent + depth + 1;
+	std::copy(parent, parent + depth + 1, path);
+	path[depth] = PathElement{feature, zero, one, depth == 0 ? 1.0 : 0.0}; // extend the path by this split
+	for (int i = depth - 1; i >= 0; i--) {
+		path[i+1].weight += one * path[i].weight * (i + 1) / (depth + 1);
+		path[i].weight    = zero * path[i].weight * (depth - i) / (depth + 1);
+	}
+
+	FlatNode const &node = nodes_[at];
+	if (node.feature < 0) {
+		if (node.child[0] != c) return;
+		for (int i = 1; i <= depth; i++) { // the weight of each feature is the path's weight with that feature unwound
+			double next = path[depth].weight, total = 0;
+			for (int j = depth - 1; j >= 0; j--) {
+				if (path[i].one != 0) {
+					double share = next / ((j + 1) * path[i].one);
+					total += share;
+					next = path[j].weight - share * path[i].zero * (depth - j);
+				} else {
+					total += path[j].weight / (path[i].zero * (depth - j));
+				}
+			}
+			phi[path[i].feature] += total * (depth + 1) * (path[i].one - path[i].zero);
+		}
+		return;
+	}
+
+	int hot  = node.child[f.feature((Feature)node.feature) >= node.threshold];
+	int cold = node.child[0] + node.child[1] - hot;
+	double incoming_zero = 1, incoming_one = 1;
+	int k = 1;
+	while (k <= depth && path[k].feature != node.feature) k++;
+	if (k <= depth) { // a feature seen higher up: unwind it, and split on both conditions at once
+		incoming_zero = path[k].zero;
+		incoming_one  = path[k].one;
+		double next = path[depth].weight;
+		for (int j = depth - 1; j >= 0; j--) {
+			if (incoming_one != 0) {
+				double weight = path[j].weight;
+				path[j].weight = next * (depth + 1) / ((j + 1) * incoming_one);
+				next = weight - path[j].weight * incoming_zero * (depth - j) / (depth + 1);
+			} else {
+				path[j].weight = path[j].weight * (depth + 1) / (incoming_zero * (depth - j));
+			}
+		}
+		for (int j = k; j < depth; j++) {
+			path[j].feature = path[j+1].feature;
+			path[j].zero    = path[j+1].zero;
+			path[j].one     = path[j+1].one;
+		}
+		depth--;
+	}
+	shap(f, c, hot, path, depth + 1, incoming_zero * nodes_[hot].cover / node.cover, incoming_one, node.feature, phi);
+	shap(f, c, cold, path, depth + 1, incoming_zero * nodes_[cold].cover / node.cover, 0, node.feature, phi);
+}
+
+Class FlatTree::predict(Flower const &f) const {
+	Class c;
+	predict(&f, 1, &c);
+	return c;
+}
+
+void FlatTree::predict(Flower const *rows, std::size_t n, Class *out) const {
+	walk(n, [rows](std::size_t i, Feature f) { return rows[i].feature(f); }, [out](std::size_t i, FlatNode const &leaf) { out[i] = (Class)leaf.child[0]; });
+}
+
+void FlatTree::predict(Columns const &columns, std::int32_t *out) const {
+	walk(columns.rows, [&columns](std::size_t i, Feature f) { return columns.lowest(i, f); }, [out](std::size_t i, FlatNode const &leaf) { out[i] = leaf.child[0]; });
+}
+
+void FlatTree::predict(Columns const &columns, double *out) const {
+	walk(columns.rows, [&columns](std::size_t i, Feature f) { return columns.lowest(i, f); }, [out](std::size_t i, FlatNode const &leaf) { out[i] = leaf.threshold; });
+}
+
+template <class Value, class Out>
+void FlatTree::walk(std::size_t n, Value value, Out out) const {
+	for (std::size_t first = 0; first < n; first += batch_rows) {
+		int size = std::min<std::size_t>(batch_rows, n - first);
+		std::int32_t at[batch_rows] = {};
+		double x[batch_rows][4]; // read once, so a step indexes the row's features rather than switching on the Feature
+		for (int i = 0; i < size; i++) {
+			for (int f = 0; f < 4; f++) x[i][f] = value(first + i, (Feature)f);
+		}
+		for (bool moving = true; moving; ) { // each row's next node is prefetched while the other rows take their step
+			moving = false;
+			for (int i = 0; i < size; i++) {
+				FlatNode const &node = nodes_[at[i]];
+				if (node.feature < 0) continue;
+				at[i] = node.child[x[i][node.feature] >= node.threshold];
+				prefetch(&nodes_[at[i]]);
+				moving = true;
+			}
+		}
+		for (int i = 0; i < size; i++) out(first + i, nodes_[at[i]]);
+	}
+}
+
+Forest::Forest() : generation_(++generations) { // index 0 is a leaf without a Class, the root of the padding lanes
+	threshold_.push_back(std::numeric_limits<double>::infinity());
+	feature_.push_back(0);
+	left_.push_back(0);
+	class_.push_back(-1);
+}
+
+void Forest::add(FlatTree const &tree) {
+	generation_ = ++generations;
+	std::vector<std::tuple<int, int, int>> pending{std::make_tuple(0, (int)threshold_.size(), 1)}; // tree index, index here, level
+	roots_.push_back(threshold_.size());
+	heights_.push_back(1);
+	threshold_.push_back(0);
+	feature_.push_back(0);
+	left_.push_back(0);
+	class_.push_back(-1);
+	for (std::size_t i = 0; i < pending.size(); i++) { // breadth first, siblings side by side
+		FlatNode const &n = tree.nodes_[std::get<0>(pending[i])];
+		int at = std::get<1>(pending[i]), level = std::get<2>(pending[i]);
+		heights_.back() = std::max(heights_.back(), level);
+		if (n.feature >= 0) {
+			threshold_[at] = n.threshold;
+			feature_[at]   = n.feature;
+			left_[at]      = threshold_.size();
+			pending.emplace_back(n.child[0], threshold_.size(), level + 1);
+			pending.emplace_back(n.child[1], threshold_.size() + 1, level + 1);
+			threshold_.resize(threshold_.size() + 2);
+			feature_.resize(feature_.size() + 2);
+			left_.resize(left_.size() + 2);
+			class_.resize(class_.size() + 2);
+		} else { // never below +inf, so the leaf points to itself
+			threshold_[at] = std::numeric_limits<double>::infinity();
+			feature_[at]   = 0;
+			left_[at]      = at;
+			class_[at]     = n.child[0];
+		}
+	}
+}
+
+Cuts Forest::cuts() const {
+	Cuts cuts(4);
+	for (std::size_t i = 0; i < left_.size(); i++) {
+		if (left_[i] != (int)i) cuts[feature_[i]].push_back(threshold_[i]);
+	}
+	for (auto &c : cuts) {
+		std::sort(c.begin(), c.end());
+		c.erase(std::unique(c.begin(), c.end()), c.end());
+	}
+	return cuts;
+}
+
+void Forest::walk(double const x[4], std::size_t first, int count[3]) const {
+	alignas(32) std::int32_t at[forest_lanes] = {}; // lanes past the last tree stay on the padding leaf
+	int steps = 0;
+	for (std::size_t t = first; t < std::min(first + forest_lanes, roots_.size()); t++) {
+		at[t - first] = roots_[t];
+		steps = std::max(steps, heights_[t] - 1);
+	}
+#ifdef __AVX2__
+	__m128i lanes[2] = { _mm_load_si128((__m128i const *)at), _mm_load_si128((__m128i const *)(at + 4)) };
+	__m256i const low = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	for (int step = 0; step < steps; step++) {
+		for (auto &lane : lanes) {
+			__m128i f  = _mm_i32gather_epi32(feature_.data(), lane, 4);
+			__m256d t  = _mm256_i32gather_pd(threshold_.data(), lane, 8);
+			__m256d v  = _mm256_i32gather_pd(x, f, 8);
+			__m256i ge = _mm256_castpd_si256(_mm256_cmp_pd(v, t, _CMP_GE_OQ));
+			__m128i go = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(ge, low)); // -1 where the row goes right
+			lane = _mm_sub_epi32(_mm_i32gather_epi32(left_.data(), lane, 4), go);
+		}
+	}
+	_mm_store_si128((__m128i *)at, lanes[0]);
+	_mm_store_si128((__m128i *)(at + 4), lanes[1]);
+#else
+	for (int step = 0; step < steps; step++) {
+		for (int i = 0; i < forest_lanes; i++) {
+			at[i] = left_[at[i]] + (x[feature_[at[i]]] >= threshold_[at[i]]);
+		}
+	}
+#endif
+	for (int i = 0; i < forest_lanes; i++) {
+		if (class_[at[i]] >= 0) count[class_[at[i]]]++;
+	}
+}
+
+bool Forest::decided(int const count[3], int walked) const {
+	int lead   = std::max({count[0], count[1], count[2]});
+	int second = count[0] + count[1] + count[2] - lead - std::min({count[0], count[1], count[2]});
+	if (lead - second > size() - walked) return true;
+	return confidence_ > 0 && walked >= confident_trees && lead >= confidence_ * walked;
+}
+
+#ifndef FDT_LIBRARY // the library predicts with single trees
+void Forest::predict(Flower const *rows, std::size_t n, Class *out) const {
+	for (std::size_t i = 0; i < n; i++) {
+		double x[4] = { rows[i].feature(SL), rows[i].feature(SW), rows[i].feature(PL), rows[i].feature(PW) };
+		int count[3] = {};
+		int walked = 0;
+		while (walked < size() && !decided(count, walked)) { // trees are always walked in the order they were added
+			walk(x, walked, count);
+			walked = std::min(walked + forest_lanes, size());
+		}
+		rows_++;
+		walked_ += walked;
+		out[i] = (Class)((count[1] > count[0] && count[1] >= count[2]) + 2 * (count[2] > count[0] && count[2] > count[1]));
+	}
+}
+#endif
+
+PredictionCache::PredictionCache(std::size_t capacity, int stripes) : keyable_(false) {
+	capacity      = std::max<std::size_t>(1, capacity);
+	stripe_count_ = std::min<std::size_t>(stripes, capacity); // no empty stripes when capacity is small
+	stripes_.reset(new Stripe[stripe_count_]);
+	for (int s = 0; s < stripe_count_; s++) stripes_[s].capacity = capacity / stripe_count_ + (s < (int)(capacity % stripe_count_));
+}
+
+void PredictionCache::reset(Cuts const &cuts, long generation) {
+	for (int s = 0; s < stripe_count_; s++) {
+		std::lock_guard<std::mutex> lock(stripes_[s].mutex);
+		stripes_[s].slots.clear();
+		stripes_[s].where.clear();
+		stripes_[s].hand = 0;
+	}
+	cuts_ = cuts;
+	int total = 0;
+	for (int f = 0; f < 4; f++) {
+		bits_[f] = 0;
+		while (((std::uint64_t)1 << bits_[f]) <= cuts_[f].size()) bits_[f]++;
+		total += bits_[f];
+	}
+	keyable_ = total <= 64;
+	model_ = generation;
+}
+
+std::uint64_t PredictionCache::key(Flower const &f) const {
+	std::uint64_t key = 0;
+	for (int i = 0; i < 4; i++) { // flowers between the same cuts on every feature take the same path in the model
+		auto &c = cuts_[i];
+		std::uint64_t interval = std::upper_bound(c.begin(), c.end(), f.feature((Feature)i)) - c.begin();
+		key = (bits_[i] ? key << bits_[i] : key) | interval;
+	}
+	return key;
+}
+
+bool PredictionCache::find(std::uint64_t key, Class &prediction) {
+	Stripe &s = stripe(key);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	auto it = s.where.find(key);
+	if (it == s.where.end()) return false;
+	s.slots[it->second].referenced = true;
+	prediction = s.slots[it->second].prediction;
+	return true;
+}
+
+void PredictionCache::insert(std::uint64_t key, Class prediction) {
+	Stripe &s = stripe(key);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	if (s.where.count(key)) return;
+	if (s.slots.size() < s.capacity) {
+		s.where[key] = s.slots.size();
+		s.slots.push_back(Slot{key, prediction, false});
+		return;
+	}
+	while (s.slots[s.hand].referenced) { // second chance for every slot hit since the hand last passed
+		s.slots[s.hand].referenced = false;
+		s.hand = (s.hand + 1) % s.slots.size();
+	}
+	s.where.erase(s.slots[s.hand].key);
+	s.where[key] = s.hand;
+	s.slots[s.hand] = Slot{key, prediction, false};
+	s.hand = (s.hand + 1) % s.slots.size();
+}
+
+template <class Model>
+void PredictionCache::predict(Model const &model, Flower const *rows, std::size_t n, Class *out) {
+	std::shared_lock<std::shared_timed_mutex> shared(model_mutex_);
+	if (model_ != model.generation()) {
+		shared.unlock();
+		{
+			std::lock_guard<std::shared_timed_mutex> exclusive(model_mutex_);
+			if (model_ != model.generation()) reset(model.cuts(), model.generation());
+		}
+		shared.lock();
+	}
+	if (!keyable_) return model.predict(rows, n, out);
+
+	for (std::size_t first = 0; first < n; first += cache_rows) { // repeats later in the batch hit what earlier rows inserted
+		std::size_t size = std::min<std::size_t>(cache_rows, n - first);
+		std::uint64_t keys[cache_rows];
+		Flower        missed[cache_rows];
+		std::size_t   at[cache_rows];
+		std::size_t   misses = 0;
+		for (std::size_t i = 0; i < size; i++) {
+			keys[i] = key(rows[first + i]);
+			if (!find(keys[i], out[first + i])) {
+				missed[misses] = rows[first + i];
+				at[misses++]   = i;
+			}
+		}
+		Class predicted[cache_rows];
+		model.predict(missed, misses, predicted);
+		for (std::size_t i = 0; i < misses; i++) {
+			out[first + at[i]] = predicted[i];
+			insert(keys[at[i]], predicted[i]);
+		}
+		lookups_ += size;
+		hits_    += size - misses;
+	}
+}
+
+#ifndef FDT_LIBRARY // command line modes
+int train_segments(std::istream &in, std::ostream &model, int depth, ThreadPool &pool) {
+	std::vector<std::pair<std::string, Flower>> rows; // lines of "segment id,flower"
+	std::string line;
+	while (getline(in, line)) {
+		std::size_t comma = line.find(',');
+		if (comma == std::string::npos) continue;
+		rows.emplace_back(line.substr(0, comma), Flower());
+		if (!rows.back().second.read_from(line.substr(comma + 1))) {
+			std::cerr << "Bad flower: " << line << std::endl;
+			return 1;
+		}
+	}
+	std::stable_sort(rows.begin(), rows.end(),
+		[](std::pair<std::string, Flower> const &r1, std::pair<std::string, Flower> const &r2) -> bool {
+			return r1.first < r2.first;
+		}
+	);
+
+	Dataset flowers; // one buffer holding every segment's flowers back to back
+	flowers.reserve(rows.size());
+	std::vector<std::string> ids;
+	std::vector<std::size_t> begins;
+	for (auto &r : rows) {
+		if (ids.empty() || ids.back() != r.first) {
+			ids.push_back(r.first);
+			begins.push_back(flowers.size());
+		}
+		flowers.push_back(r.second);
+	}
+	begins.push_back(flowers.size());
+	rows = decltype(rows)();
+
+	std::vector<std::unique_ptr<FlatTree>> trees(ids.size());
+	std::vector<std::future<void>> built;
+	for (std::size_t s = 0; s < ids.size(); s++) {
+		built.push_back(pool.submit([&, s] {
+			Node tree(Flowers(flowers.begin() + begins[s], flowers.begin() + begins[s+1]), "");
+			tree.set_max_depth(depth);
+			tree.build_tree();
+			trees[s] = std::make_unique<FlatTree>(tree);
+		}));
+	}
+	std::size_t nodes = 0;
+	for (std::size_t s = 0; s < ids.size(); s++) {
+		pool.wait(built[s]);
+		model << "segment " << ids[s] << '\n';
+		trees[s]->save(model);
+		nodes += trees[s]->size();
+		trees[s].reset();
+	}
+	std::cout << "Segments:\t" << ids.size() << " trees, " << nodes << " nodes from " << flowers.size() << " flowers" << std::endl;
+	return 0;
+}
+
+bool train_forest(Forest &forest, Dataset const &train, int trees, Params const &params, std::string const &name, unsigned seed,
+	Checkpoint const &checkpoint, ThreadPool &pool) {
+	if (!checkpoint.path.empty() && checkpoint.every < 1) {
+		std::cerr << "Checkpoints need at least 1 tree between them" << std::endl;
+		return false;
+	}
+	std::mt19937 g(seed);
+	std::uniform_int_distribution<std::size_t> pick(0, train.size() - 1);
+	std::uint64_t dataset = fingerprint(train);
+	auto columns = columns_of(train.data(), train.size(), &pool); // every bootstrap sample indexes the same copy
+	std::vector<std::unique_ptr<FlatTree>> done;
+	if (checkpoint.resume) {
+		std::ifstream in(checkpoint.path);
+		std::string tag;
+		std::uint64_t saved = 0;
+		int count = 0, total = 0, depth = 0, min_leaf = 0;
+		unsigned saved_seed = 0;
+		in >> tag >> tag >> saved >> tag >> count >> tag >> total >> tag >> depth >> tag >> min_leaf >> tag >> saved_seed >> tag >> g;
+		if (!in || saved != dataset || total != trees || depth != params.max_depth || min_leaf != params.min_leaf || saved_seed != seed) {
+			std::cerr << "Checkpoint " << checkpoint.path << " is missing or belongs to another run" << std::endl;
+			return false;
+		}
+		for (int t = 0; t < count; t++) done.push_back(std::make_unique<FlatTree>(in));
+		if (!in) {
+			std::cerr << "Checkpoint " << checkpoint.path << " holds a damaged tree" << std::endl;
+			return false;
+		}
+	}
+
+	std::future<bool> writing;
+	auto written = [&] { // false if the last write failed; the previous checkpoint is then still in place
+		if (writing.valid() && !writing.get()) std::cerr << "Checkpoint " << checkpoint.path << " could not be written" << std::endl;
+	};
+	auto save = [&](std::string const &state) { // snapshot on this thread, write on another, then rename into place
+		std::ostringstream out;
+		out << "fdt-checkpoint\ndataset " << dataset << "\ntrees " << done.size() << " of " << trees << "\ndepth " << params.max_depth
+			<< "\nmin-leaf " << params.min_leaf << "\nseed " << seed << "\nrng " << state << '\n';
+		for (auto &t : done) t->save(out);
+		written();
+		writing = std::async(std::launch::async, [path = checkpoint.path, text = out.str()] {
+			std::ofstream file(path + ".tmp");
+			file << text;
+			file.close();
+			if (!file) { // a short write must not replace the last good checkpoint
+				std::remove((path + ".tmp").c_str());
+				return false;
+			}
+			return std::rename((path + ".tmp").c_str(), path.c_str()) == 0;
+		});
+	};
+
+	std::deque<std::pair<std::unique_ptr<Node>, std::future<void>>> building; // bounded, so samples don't pile up
+	std::deque<std::string> states; // the generator after drawing each building tree's sample
+	for (int t = done.size(); t < trees || !building.empty(); ) {
+		if (t < trees && building.size() < 2 * (std::size_t)forest_lanes) { // bagging: a bootstrap sample per tree
+			Rows sample(train.size());
+			for (auto &r : sample) r = pick(g);
+			std::ostringstream state;
+			state << g;
+			states.push_back(state.str());
+			Params drawn = params;
+			drawn.ties = (std::uint64_t)seed << 32 | (t + 1); // by seed and tree number, so a resumed forest breaks ties as an uninterrupted one
+			building.emplace_back(std::make_unique<Node>(columns, std::move(sample), name, drawn), std::future<void>());
+			Node *tree = building.back().first.get();
+			building.back().second = pool.submit([tree, &pool] { tree->build_tree(&pool); });
+			t++;
+			continue;
+		}
+		pool.wait(building.front().second);
+		done.push_back(std::make_unique<FlatTree>(*building.front().first));
+		building.pop_front();
+		if (!checkpoint.path.empty() && (done.size() % checkpoint.every == 0 || (int)done.size() == trees)) save(states.front());
+		states.pop_front();
+	}
+	written();
+	for (auto &t : done) forest.add(*t);
+	return true;
+}
+
+int train_regression(std::istream &in, std::size_t vset_begin, std::size_t vset_end, Params const &params, std::string const &name,
+	ThreadPool &pool) {
+	struct Store {
+		Column<double> values[4];
+		Column<double> response;
+		Columns        columns;
+	};
+	auto store = std::make_shared<Store>();
+	std::vector<double> read[5]; // as parsed, before the pool's workers copy them into the columns
+	std::string line;
+	while (getline(in, line)) { // "sepal length,sepal width,petal length,petal width,response"
+		std::stringstream ss(line);
+		double value;
+		char comma;
+		for (int f = 0; f < 4; f++) {
+			ss >> value >> comma;
+			read[f].push_back(value);
+		}
+		ss >> value;
+		read[4].push_back(value);
+	}
+	std::size_t rows = read[4].size();
+	if (rows > max_rows) {
+		std::cerr << "More than " << max_rows << " flowers" << std::endl;
+		return 1;
+	}
+	if (vset_begin > vset_end || vset_end > rows) {
+		std::cerr << "Validation set out of range" << std::endl;
+		return 1;
+	}
+	for (int f = 0; f < 5; f++) {
+		auto &column = f < 4 ? store->values[f] : store->response;
+		fill_column(column, rows, &pool, [&read, f](std::size_t i) { return read[f][i]; });
+		read[f] = std::vector<double>();
+	}
+	for (int f = 0; f < 4; f++) store->columns.feature[f] = store->values[f].data();
+	store->columns.classes = nullptr;
+	store->columns.response = store->response.data();
+	store->columns.rows = rows;
+	std::shared_ptr<Columns const> columns(store, &store->columns);
+
+	SortedColumns sorted(*columns, 0, "");
+	auto tree = train_async(columns, sorted.without(vset_begin, vset_end), params, name, pool).get();
+	FlatTree model(*tree);
+	std::vector<double> predicted(rows);
+	model.predict(*columns, predicted.data());
+	double train = 0, test = 0; // sums of squared errors
+	for (std::size_t i = 0; i < rows; i++) {
+		double error = predicted[i] - store->response[i];
+		(i >= vset_begin && i < vset_end ? test : train) += error * error;
+	}
+	std::size_t valid = vset_end - vset_begin;
+	std::cout << "Validation Set:\tFlowers " << vset_begin << " to " << vset_end-1 << std::endl;
+	std::cout << "Nodes:\t" << model.size() << std::endl;
+	std::cout << "Train RMSE:\t" << (rows > valid ? std::sqrt(train / (rows - valid)) : 0) << std::endl;
+	std::cout << "Test RMSE:\t" << (valid ? std::sqrt(test / valid) : 0) << std::endl;
+	return 0;
+}
+
+int train_targets(std::istream &in, int targets, std::size_t vset_begin, std::size_t vset_end, Params const &params,
+	std::string const &name, ThreadPool &pool) {
+	struct Store {
+		Column<double>       values[4];
+		Column<std::int32_t> classes;
+		Columns              columns;
+	};
+	auto store = std::make_shared<Store>();
+	std::vector<double>       values[4]; // as parsed, before the pool's workers copy them into the columns
+	std::vector<std::int32_t> classes;
+	std::string line;
+	while (getline(in, line)) { // "sepal length,sepal width,petal length,petal width,class of each target"
+		std::stringstream ss(line);
+		double value, c;
+		char comma;
+		for (auto &v : values) {
+			ss >> value >> comma;
+			v.push_back(value);
+		}
+		for (int t = 0; t < targets; t++) {
+			if (!(ss >> c) || c < setosa || c > virginica) { // other Classes would index past the counts
+				std::cerr << "Bad flower: " << line << std::endl;
+				return 1;
+			}
+			ss >> comma;
+			classes.push_back(c);
+		}
+	}
+	std::size_t rows = values[0].size();
+	if (rows > max_rows) {
+		std::cerr << "More than " << max_rows << " flowers" << std::endl;
+		return 1;
+	}
+	if (targets < 1 || targets > max_targets || vset_begin > vset_end || vset_end > rows) {
+		std::cerr << "Targets not from 1 to " << max_targets << " or validation set out of range" << std::endl;
+		return 1;
+	}
+	for (int f = 0; f < 4; f++) {
+		fill_column(store->values[f], rows, &pool, [&values, f](std::size_t i) { return values[f][i]; });
+		values[f] = std::vector<double>();
+	}
+	fill_column(store->classes, classes.size(), &pool, [&classes](std::size_t i) { return classes[i]; });
+	classes = std::vector<std::int32_t>();
+	for (int f = 0; f < 4; f++) store->columns.feature[f] = store->values[f].data();
+	store->columns.classes = store->classes.data();
+	store->columns.rows = rows;
+	store->columns.targets = targets;
+	std::shared_ptr<Columns const> columns(store, &store->columns);
+
+	SortedColumns sorted(*columns, 0, "");
+	auto tree = train_async(columns, sorted.without(vset_begin, vset_end), params, name, pool).get();
+	FlatTree model(*tree);
+	std::vector<std::int32_t> predicted(rows);
+	model.predict(*columns, predicted.data()); // one walk for every target
+	std::cout << "Validation Set:\tFlowers " << vset_begin << " to " << vset_end-1 << std::endl;
+	std::cout << "Nodes:\t" << model.size() << " shared by " << targets << " targets" << std::endl;
+	for (int t = 0; t < targets; t++) {
+		int train = 0, test = 0;
+		for (std::size_t i = 0; i < rows; i++) {
+			bool valid = i >= vset_begin && i < vset_end;
+			(valid ? test : train) += predicted[i] % 3 == columns->get_class(i, t);
+			predicted[i] /= 3;
+		}
+		std::cout << "Target " << t << " Accuracy:\ttrain " << train << '/' << rows - (vset_end - vset_begin)
+			<< ", test " << test << '/' << vset_end - vset_begin << std::endl;
+	}
+	return 0;
+}
+
+int train_binned(std::string const &path, int bins, std::size_t vset_begin, std::size_t vset_end, Params const &params,
+	std::string const &name, ThreadPool &pool) {
+	auto columns = bins >= 2 && bins <= 256 ? read_binned(path, bins) : nullptr;
+	if (!columns || vset_begin > vset_end || vset_end > columns->rows) {
+		std::cerr << "Cannot read " << path << ", bins not from 2 to 256 or validation set out of range" << std::endl;
+		return 1;
+	}
+	SortedColumns sorted(*columns, 0, "");
+	auto tree = train_async(columns, sorted.without(vset_begin, vset_end), params, name, pool).get();
+	FlatTree model(*tree);
+	std::vector<std::int32_t> predicted(columns->rows);
+	model.predict(*columns, predicted.data());
+	int train = 0, test = 0;
+	for (std::size_t i = 0; i < predicted.size(); i++) {
+		bool valid = i >= vset_begin && i < vset_end;
+		(valid ? test : train) += predicted[i] == columns->classes[i];
+	}
+	std::cout << "Validation Set:\tFlowers " << vset_begin << " to " << vset_end-1 << std::endl;
+	tree->print_tree();
+	std::cout << "\nTrain Accuracy:\t" << train << '/' << columns->rows - (vset_end - vset_begin) << std::endl;
+	std::cout << "Test Accuracy:\t" << test << '/' << vset_end - vset_begin << std::endl;
+	std::cout << "Bins:\t" << bins << " per feature, " << columns->rows << " flowers at 1 byte per value" << std::endl;
+	return 0;
+}
+
+int run_jobs(std::istream &spec, Dataset const &flowers, std::string const &cache_dir, ThreadPool &pool) {
+	struct Job {
+		std::size_t begin, end; // validation flowers
+		Params      params;
+		int         nodes, train, test; // results
+	};
+	std::vector<Job> jobs;
+	std::string line;
+	while (spec && getline(spec, line)) { // "start, end, depth[, minimum leaf]", commas optional; blank lines and # comments are skipped
+		std::size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#') continue;
+		std::string fields = line;
+		std::replace(fields.begin(), fields.end(), ',', ' ');
+		std::istringstream in(fields);
+		std::vector<long> values;
+		long value;
+		while (in >> value) values.push_back(value);
+		Job job{};
+		if (values.size() >= 3) {
+			job.begin = std::max(0L, values[0]);
+			job.end   = std::max(0L, values[1]);
+			job.params.max_depth = values[2];
+			if (values.size() == 4) job.params.min_leaf = values[3];
+		}
+		if (!in.eof() || values.size() < 3 || values.size() > 4 || values[0] < 0 || values[1] < 0 || job.begin > job.end || job.end > flowers.size()
+			|| job.params.min_leaf < 1) {
+			std::cerr << "Bad job: " << line << std::endl;
+			return 1;
+		}
+		jobs.push_back(job);
+	}
+	if (!spec.eof()) { // missing, a directory or failing mid-file
+		std::cerr << "Cannot read the job file" << std::endl;
+		return 1;
+	}
+
+	auto columns = columns_of(flowers.data(), flowers.size(), &pool); // parsed, copied and sorted once for every job
+	SortedColumns const sorted(*columns, fingerprint(flowers), cache_dir);
+	std::vector<std::future<void>> done;
+	for (auto &job : jobs) {
+		done.push_back(pool.submit([&job, &columns, &sorted, &pool] {
+			Node tree(columns, sorted.without(job.begin, job.end), "", job.params);
+			tree.build_tree(&pool);
+			FlatTree model(tree);
+			std::vector<std::int32_t> predicted(columns->rows);
+			model.predict(*columns, predicted.data());
+			job.nodes = model.size();
+			job.train = job.test = 0;
+			for (std::size_t i = 0; i < predicted.size(); i++) {
+				bool valid = i >= job.begin && i < job.end;
+				(valid ? job.test : job.train) += predicted[i] == columns->classes[i];
+			}
+		}));
+	}
+	std::cout << "Job\tValidation\tDepth\tMin Leaf\tNodes\tTrain Accuracy\tTest Accuracy" << std::endl;
+	for (std::size_t j = 0; j < jobs.size(); j++) {
+		pool.wait(done[j]);
+		Job const &job = jobs[j];
+		std::cout << j << '\t' << job.begin << '-' << job.end << '\t' << job.params.max_depth << '\t' << job.params.min_leaf << '\t' << job.nodes
+			<< '\t' << job.train << '/' << flowers.size() - (job.end - job.begin) << '\t' << job.test << '/' << job.end - job.begin << std::endl;
+	}
+	return 0;
+}
+
+int tune(Dataset const &train, Dataset const &valid, int max_depth, ThreadPool &pool) {
+	struct Config {
+		Params params;
+		int    correct;
+	};
+	std::vector<Config> configs;
+	for (int depth = 1; depth <= max_depth; depth++) {
+		for (int leaf : {1, 2, 4, 8, 16}) {
+			configs.push_back(Config{Params(), 0});
+			configs.back().params.max_depth = depth;
+			configs.back().params.min_leaf  = leaf;
+		}
+	}
+	if (train.empty() || valid.empty() || configs.empty()) return 1;
+
+	Dataset shuffled(train); // every rung trains on a prefix of the same shuffled flowers
+	std::mt19937 g(1);
+	std::shuffle(shuffled.begin(), shuffled.end(), g);
+	auto columns = columns_of(shuffled.data(), shuffled.size(), &pool); // parsed and sorted once for every rung and configuration
+	Orders const sorted = presort(*columns, all_rows(columns->rows));
+	int rungs = 0;
+	while (((std::size_t)1 << rungs) < configs.size()) rungs++;
+	for (int rung = 0; ; rung++) {
+		std::size_t size = std::max(std::min<std::size_t>(2, shuffled.size()), shuffled.size() >> (rungs - rung));
+		Orders prefix; // the first size flowers, still in order
+		for (int f = 0; f < 4; f++) {
+			std::copy_if(sorted[f].begin(), sorted[f].end(), std::back_inserter(prefix[f]), [size](std::uint32_t r) { return r < size; });
+		}
+		std::vector<std::future<void>> done;
+		for (auto &c : configs) {
+			done.push_back(pool.submit([&c, &columns, &prefix, &valid] {
+				Node tree(columns, prefix, "", c.params);
+				tree.build_tree();
+				FlatTree model(tree);
+				std::vector<Class> predicted(valid.size());
+				model.predict(valid.data(), valid.size(), predicted.data());
+				c.correct = 0;
+				for (std::size_t i = 0; i < valid.size(); i++) c.correct += predicted[i] == valid[i].get_class();
+			}));
+		}
+		for (auto &d : done) pool.wait(d);
+		std::stable_sort(configs.begin(), configs.end(), [](Config const &c1, Config const &c2) { return c1.correct > c2.correct; });
+		std::cout << "Rung " << rung << ":\t" << configs.size() << " configurations on " << size << " flowers, best "
+			<< configs[0].correct << '/' << valid.size() << std::endl;
+		if (configs.size() == 1) break;
+		configs.resize((configs.size() + 1) / 2); // the better half goes on to twice the flowers
+	}
+	std::cout << "Best:\tdepth " << configs[0].params.max_depth << ", min leaf " << configs[0].params.min_leaf << std::endl;
+	return 0;
+}
+#endif
+
 } // namespace fdt
 
+struct fdt_model {
+	fdt::FlatTree tree;
+};
+
+namespace {
+	fdt::Columns columns_of(double const *const features[4], int32_t const *classes, size_t rows) { // borrows the caller's arrays
+		fdt::Columns columns;
+		std::copy(features, features + 4, columns.feature);
+		columns.classes = classes;
+		columns.rows = rows;
+		return columns;
+	}
+
+	fdt::ThreadPool &library_pool() { // started by the first training
+		static fdt::ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+		return pool;
+	}
+}
+
+extern "C" {
+
+fdt_model *fdt_train(double const *const features[4], int32_t const *classes, size_t rows, int max_depth, int min_leaf) {
+	if (rows == 0 || rows > fdt::max_rows) return nullptr;
+	for (size_t i = 0; i < rows; i++) {
+		if (classes[i] < fdt::setosa || classes[i] > fdt::virginica) return nullptr;
+	}
+	try {
+		fdt::Params params;
+		params.max_depth = max_depth;
+		params.min_leaf  = std::max(1, min_leaf);
+		auto columns = std::make_shared<fdt::Columns const>(columns_of(features, classes, rows));
+		auto root = fdt::train_async(columns, params, "", library_pool()).get();
+		return new fdt_model{fdt::FlatTree(*root)};
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void fdt_predict(fdt_model const *model, double const *const features[4], size_t rows, int32_t *classes) {
+	model->tree.predict(columns_of(features, nullptr, rows), classes);
+}
+
+fdt_model *fdt_load(char const *path) {
+	std::ifstream in(path);
+	if (!in) return nullptr;
+	try {
+		fdt_model *model = new fdt_model{fdt::FlatTree(in)};
+		if (in) return model;
+		delete model;
+	} catch (...) {
+	}
+	return nullptr;
+}
+
+int fdt_save(fdt_model const *model, char const *path) {
+	std::ofstream out(path);
+	model->tree.save(out);
+	return out ? 0 : -1;
+}
+
+void fdt_free(fdt_model *model) {
+	delete model;
+}
+
+}
+
+#ifndef FDT_LIBRARY
+
 int main(int argc, char **argv) {
-	std::vector<fdt::Flower> tflowers;
+	char *threads = fdt::option(argc, argv, "threads");
+	char *bench   = fdt::option(argc, argv, "bench");
+	bool simplify = fdt::flag(argc, argv, "simplify");
+	bool dag      = fdt::flag(argc, argv, "dag");
+	char *layout  = fdt::option(argc, argv, "layout");
+	char *trees   = fdt::option(argc, argv, "trees");
+	char *seed    = fdt::option(argc, argv, "seed");
+	char *confidence = fdt::option(argc, argv, "confidence");
+	char *cached  = fdt::option(argc, argv, "cache");
+	char *segments = fdt::option(argc, argv, "segments");
+	bool explain  = fdt::flag(argc, argv, "explain");
+	bool tune     = fdt::flag(argc, argv, "tune");
+	char *min_leaf = fdt::option(argc, argv, "min-leaf");
+	char *budget  = fdt::option(argc, argv, "time-budget");
+	char *checkpoint = fdt::option(argc, argv, "checkpoint");
+	char *every   = fdt::option(argc, argv, "checkpoint-every");
+	bool resume   = fdt::flag(argc, argv, "resume");
+	char *jobs    = fdt::option(argc, argv, "jobs");
+	char *cache_dir = fdt::option(argc, argv, "cache-dir");
+	char *bins    = fdt::option(argc, argv, "bins");
+	char *input   = fdt::option(argc, argv, "input");
+	char *targets = fdt::option(argc, argv, "targets");
+	bool regression = fdt::flag(argc, argv, "regression");
+	fdt::ThreadPool pool(threads ? atoi(threads) : std::max(1u, std::thread::hardware_concurrency()));
+
+	if (segments) {
+		std::ofstream model(segments);
+		int status = model ? fdt::train_segments(std::cin, model, atoi(argv[1]), pool) : 1;
+		model.close(); // flushes, so a full disk shows up here
+		if (!model) std::cerr << "Model " << segments << " could not be written" << std::endl;
+		return model ? status : 1;
+	}
+
+	if (regression) {
+		fdt::Params params;
+		params.max_depth = atoi(argv[3]) + std::string(argc > 4 ? argv[4] : "").size();
+		params.min_leaf  = min_leaf ? atoi(min_leaf) : 1;
+		return fdt::train_regression(std::cin, atoi(argv[1]), atoi(argv[2]), params, (argc > 4 ? argv[4] : ""), pool);
+	}
+
+	if (targets) {
+		fdt::Params params;
+		params.max_depth = atoi(argv[3]) + std::string(argc > 4 ? argv[4] : "").size();
+		params.min_leaf  = min_leaf ? atoi(min_leaf) : 1;
+		return fdt::train_targets(std::cin, atoi(targets), atoi(argv[1]), atoi(argv[2]), params, (argc > 4 ? argv[4] : ""), pool);
+	}
+
+	if (bins) {
+		fdt::Params params;
+		params.max_depth = atoi(argv[3]) + std::string(argc > 4 ? argv[4] : "").size();
+		params.min_leaf  = min_leaf ? atoi(min_leaf) : 1;
+		return fdt::train_binned(input ? input : "", atoi(bins), atoi(argv[1]), atoi(argv[2]), params, (argc > 4 ? argv[4] : ""), pool);
+	}
+
+	fdt::Dataset tflowers;
 	std::string line;
 	while (getline(std::cin, line)) {
 		fdt::Flower f;
-		f.read_from(line);
+		if (!f.read_from(line)) {
+			std::cerr << "Bad flower: " << line << std::endl;
+			return 1;
+		}
 		tflowers.push_back(f);
 	}
+	if (tflowers.size() > fdt::max_rows) {
+		std::cerr << "More than " << fdt::max_rows << " flowers" << std::endl;
+		return 1;
+	}
+
+	if (jobs) {
+		std::ifstream spec(jobs);
+		return fdt::run_jobs(spec, tflowers, cache_dir ? cache_dir : "", pool);
+	}
 
 	int vset_begin = atoi(argv[1]), vset_end = atoi(argv[2]);
-	std::vector<fdt::Flower> vflowers(tflowers.begin() + vset_begin, tflowers.begin() + vset_end);
+	auto columns = fdt::columns_of(tflowers.data(), tflowers.size(), &pool); // all flowers; the tree skips the validation set
+	fdt::SortedColumns sorted(*columns, fdt::fingerprint(tflowers), cache_dir ? cache_dir : "");
+	fdt::Dataset vflowers(tflowers.begin() + vset_begin, tflowers.begin() + vset_end);
 	tflowers.erase(tflowers.begin() + vset_begin, tflowers.begin() + vset_end);
 
-	fdt::Node ttree(tflowers, (argc > 4 ? argv[4] : ""));
-	ttree.set_max_depth(atoi(argv[3]));
-	ttree.build_tree();
+	if (tune) return fdt::tune(tflowers, vflowers, atoi(argv[3]), pool);
 
-	int correctt = 0;
-	for (auto &f : tflowers) {
-		if (ttree.validate_flower(f)) {
-			correctt++;
-		}
+	std::string name = argc > 4 ? argv[4] : "";
+	fdt::Params params;
+	params.max_depth = atoi(argv[3]) + name.size();
+	params.min_leaf  = min_leaf ? atoi(min_leaf) : 1;
+	std::unique_ptr<fdt::Node> root;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(budget ? atof(budget) : 0);
+	int cut = 0;
+	if (budget) {
+		root = std::make_unique<fdt::Node>(columns, sorted.without(vset_begin, vset_end), name, params);
+		cut = root->build_best_first(std::chrono::time_point_cast<std::chrono::steady_clock::duration>(deadline));
+	} else {
+		root = fdt::train_async(columns, sorted.without(vset_begin, vset_end), params, name, pool).get();
 	}
+	fdt::Node &ttree = *root;
+	int removed = simplify ? ttree.simplify() : 0;
 
-	int correctv = 0;
-	for (auto &f : vflowers) {
-		if (ttree.validate_flower(f)) {
-			correctv++;
+	fdt::FlatTree model(ttree, fdt::layout_of(layout ? layout : "dfs"));
+	if (dag) model.share_subtrees();
+	auto correct = [](auto const &predictor, fdt::Dataset const &flowers) {
+		std::vector<fdt::Class> predicted(flowers.size());
+		predictor.predict(flowers.data(), flowers.size(), predicted.data());
+		int count = 0;
+		for (std::size_t i = 0; i < flowers.size(); i++) {
+			if (predicted[i] == flowers[i].get_class()) {
+				count++;
+			}
 		}
+		return count;
+	};
+	fdt::PredictionCache cache(cached ? atol(cached) : 0);
+	int correctt = cached ? correct(fdt::Cached<fdt::FlatTree>(model, cache), tflowers) : correct(model, tflowers);
+	int correctv = cached ? correct(fdt::Cached<fdt::FlatTree>(model, cache), vflowers) : correct(model, vflowers);
+
+	fdt::Forest forest;
+	if (trees) {
+		fdt::Checkpoint saves;
+		saves.path   = checkpoint ? checkpoint : "";
+		saves.every  = every ? atoi(every) : 8;
+		saves.resume = resume;
+		if (!fdt::train_forest(forest, tflowers, atoi(trees), params, name, seed ? atoi(seed) : 1, saves, pool)) return 1;
+		if (confidence) forest.set_confidence(atof(confidence));
 	}
 
 	std::cout << "Validation Set:\tFlowers " << vset_begin << " to " << vset_end-1 << std::endl;
@@ -272,4 +2531,45 @@ int main(int argc, char **argv) {
 	ttree.print_tree();
 	std::cout << "\nTrain Accuracy:\t" << correctt << '/' << tflowers.size() << std::endl;
 	std::cout << "Test Accuracy:\t" << correctv << '/' << vflowers.size() << std::endl;
+	if (trees) {
+		std::cout << "Forest Train Accuracy:\t" << correct(forest, tflowers) << '/' << tflowers.size() << " (" << forest.size() << " trees)" << std::endl;
+		std::cout << "Forest Test Accuracy:\t" << correct(forest, vflowers) << '/' << vflowers.size() << std::endl;
+		std::cout << "Forest Trees/Row:\t" << std::setprecision(2) << forest.trees_per_row() << std::endl;
+	}
+	std::cout << "Importance:\t" << std::setprecision(3);
+	for (auto f : {fdt::SL, fdt::SW, fdt::PL, fdt::PW}) {
+		std::cout << (f == fdt::SL ? "" : ", ") << fdt::feature_names[f] << ' ' << model.importance(f) << " in " << model.splits(f) << " splits";
+	}
+	std::cout << std::endl;
+	if (explain) { // cover-based attributions need the tree before subtrees are shared
+		fdt::FlatTree tree(ttree);
+		std::vector<std::array<double, 5>> phi(vflowers.size());
+		tree.explain(vflowers.data(), vflowers.size(), phi.data(), &pool);
+		for (std::size_t i = 0; i < vflowers.size(); i++) {
+			std::cout << "Explain " << vset_begin + i << ":\tclass " << tree.predict(vflowers[i]) << " = " << std::setprecision(3) << phi[i][4];
+			for (int f = 0; f < 4; f++) std::cout << (phi[i][f] < 0 ? " - " : " + ") << std::abs(phi[i][f]) << ' ' << fdt::feature_names[f];
+			std::cout << std::endl;
+		}
+	}
+	if (budget) std::cout << "Time Budget:\t" << budget << " s, " << cut << " splits left out" << std::endl;
+	if (cache_dir) std::cout << "Sort Cache:\t" << (sorted.hit() ? "hit" : "miss") << " in " << cache_dir << std::endl;
+	if (cached) std::cout << "Cache:\t" << cache.hits() << '/' << cache.lookups() << " hits" << std::endl;
+	if (simplify || dag) std::cout << "Simplified:\t" << removed << " nodes removed, " << model.size() << " flat nodes" << std::endl;
+	std::cout << "Huge Pages:\t";
+	for (int b = fdt::dataset_buffer; b <= fdt::scratch_buffer; b++) {
+		auto &s = fdt::page_stats[b];
+		std::cout << (b == fdt::dataset_buffer ? "dataset " : ", scratch ") << s.hugetlb << '+' << s.thp << '/' << s.buffers;
+	}
+	std::cout << " (hugetlb+thp of buffers >= 2 MB)" << std::endl;
+
+	for (char const *name : {"dfs", "bfs", "veb"}) {
+		if (!bench) break;
+		fdt::FlatTree layout(ttree, fdt::layout_of(name));
+		std::vector<fdt::Class> predicted(tflowers.size());
+		auto start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < atoi(bench); pass++) layout.predict(tflowers.data(), tflowers.size(), predicted.data());
+		std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+		std::cout << "Predict " << name << ":\t" << std::setprecision(2) << took.count() / atoi(bench) / tflowers.size() << " ns/flower" << std::endl;
+	}
 }
+#endif